@@ -0,0 +1,108 @@
+// times loading a worksheet with pugixml against mapping its snapshot, and
+// converting each; usage: bench_snapshot [<worksheet> [<repetitions>]]
+// without a worksheet, a large synthetic one is generated
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "pugixml.hpp"
+#include "matlab.hpp"
+#include "snapshot.hpp"
+
+namespace fs = std::filesystem;
+
+static std::string synthetic(int regions)
+{
+	std::string xml = R"(<?xml version="1.0"?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30"><regions>)";
+	for (int i = 0; i < regions; ++i)
+	{
+		const auto n = std::to_string(i);
+		xml += R"(<region region-id=")" + n + R"(" left="12" top=")" + n + R"(" width="100" height="20"><math optimize="false" disable-calc="false">)"
+			R"(<ml:define><ml:id subscript=")" + n + R"(">x</ml:id><ml:apply><ml:plus/><ml:apply><ml:mult/><ml:real>)" + n +
+			R"(</ml:real><ml:apply><ml:sqrt/><ml:id>a</ml:id></ml:apply></ml:apply><ml:apply><ml:pow/><ml:id>b</ml:id><ml:real>2</ml:real></ml:apply></ml:apply></ml:define>)"
+			R"(</math><rendering item-idref=")" + n + R"("/></region>)";
+	}
+	return xml + "</regions></worksheet>";
+}
+
+template <typename F>
+static double best_of(int repetitions, F &&f)
+{
+	double best = 1e300;
+	for (int i = 0; i < repetitions; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const auto dir = fs::temp_directory_path() / "mathcadconvert_bench_snapshot";
+	fs::create_directories(dir);
+	std::string worksheet = argc > 1 ? argv[1] : (dir / "synthetic.xmcd").string();
+	const int repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+	if (argc <= 1)
+	{
+		const auto xml = synthetic(200000);
+		std::ofstream(worksheet, std::ios::binary).write(xml.data(), xml.size());
+	}
+	const auto path = (dir / "bench.mcsnap").string();
+	{
+		pugi::xml_document doc;
+		if (!doc.load_file(worksheet.c_str()) || !snapshot::write(doc, path, matlab::skipped))
+		{
+			std::cerr << worksheet << ": error: could not load or snapshot\n";
+			return 2;
+		}
+	}
+
+	std::size_t sink = 0;
+	const auto load = best_of(repetitions, [&]
+	{
+		pugi::xml_document doc;
+		sink += bool(doc.load_file(worksheet.c_str()));
+	});
+	const auto map = best_of(repetitions, [&]
+	{
+		snapshot::file file(path);
+		sink += bool(file);
+	});
+	const auto verify = best_of(repetitions, [&]
+	{
+		snapshot::file file(path);
+		sink += file.verify();
+	});
+	const auto convert_xml = best_of(repetitions, [&]
+	{
+		pugi::xml_document doc;
+		doc.load_file(worksheet.c_str());
+		std::ostringstream os;
+		matlab::context ctx;
+		ctx.convert(doc, os);
+		sink += os.view().size();
+	});
+	const auto convert_snapshot = best_of(repetitions, [&]
+	{
+		snapshot::file file(path);
+		file.verify();
+		std::ostringstream os;
+		matlab::context ctx;
+		ctx.convert(file.document(), os);
+		sink += os.view().size();
+	});
+
+	std::cout << worksheet << ": " << fs::file_size(worksheet) << " bytes, snapshot " << fs::file_size(path) << " bytes\n"
+			  << "load_file               " << load << " ms\n"
+			  << "snapshot open           " << map << " ms\n"
+			  << "snapshot open+verify    " << verify << " ms\n"
+			  << "load_file+convert       " << convert_xml << " ms\n"
+			  << "snapshot+verify+convert " << convert_snapshot << " ms\n";
+	fs::remove_all(dir);
+	return sink ? 0 : 1;
+}
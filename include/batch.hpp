@@ -0,0 +1,23 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cache.hpp"
+#include "matlab.hpp"
+
+namespace batch
+{
+    // reads, parses and converts one worksheet, writing the script followed by
+    // its undefined ids to os; with a cache, unchanged inputs are not parsed.
+    // extract writes its binaryContent items to binary_dir while converting.
+    // snapshots are mapped and converted as they are, without the cache; their
+    // plots refer to items extracted earlier, if there are any
+    pugi::xml_parse_result convert_file(const std::string& path, std::ostream& os, matlab::context& ctx, cache::directory* cache = nullptr, bool extract = false);
+    // the .m file a worksheet is converted to
+    std::string output_path(const std::string& path);
+    // the directory beside it that its binaryContent items are extracted to
+    std::string binary_dir(const std::string& path);
+    // converts every file to its output_path on a pool of jobs threads;
+    // returns the exit status
+    int run(const std::vector<std::string>& files, const matlab::options&, unsigned jobs, cache::directory* cache = nullptr, bool extract = false);
+}
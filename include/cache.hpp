@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cache
+{
+    // XXH64 of data
+    std::uint64_t hash(std::string_view data, std::uint64_t seed = 0);
+
+    // a directory of finished conversions keyed by the hash of their input,
+    // safe to share between threads and processes: entries are written
+    // through a temporary file and rename, and read only when complete
+    class directory
+    {
+    public:
+        // settings must describe everything besides the input that changes the
+        // output, e.g. converter version and options
+        directory(std::filesystem::path root, std::uintmax_t max_bytes, std::string_view settings);
+
+        std::uint64_t key(std::string_view input) const;
+        // streams a stored script to os and returns its undefined ids, or
+        // returns false without writing anything on a miss
+        bool load(std::uint64_t key, std::size_t input_size, std::ostream& os, std::vector<std::string>& undefined_ids) const;
+        void store(std::uint64_t key, std::size_t input_size, std::string_view script, const std::set<std::string>& undefined_ids);
+
+    private:
+        std::filesystem::path entry(std::uint64_t key) const;
+        // removes the least recently used entries until under 90% of max_bytes
+        void evict();
+
+        std::filesystem::path root;
+        std::uintmax_t max_bytes;
+        std::uint64_t seed;
+        std::atomic<std::uintmax_t> size;
+        std::mutex evicting;
+    };
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "pugixml.hpp"
+
+namespace check
+{
+    // an <ml:eval> whose computed value differs from its stored <result>, or
+    // that could not be evaluated (actual then holds "error: ...")
+    struct mismatch
+    {
+        std::string region;
+        std::string expected;
+        std::string actual;
+    };
+    struct report
+    {
+        std::size_t checked = 0;
+        std::vector<mismatch> mismatches;
+    };
+
+    // evaluates every math region in worksheet order and compares each
+    // <result> to the value computed natively, within a relative tolerance;
+    // differences below zero count as equal, as Mathcad shows smaller
+    // magnitudes as 0
+    report worksheet(const pugi::xml_node&, double tolerance = 1e-6, double zero = 1e-15);
+}
@@ -4,4 +4,6 @@
 #include "pugixml.hpp"
 
 //using converter_func = void(*)(const pugi::xml_node&, std::ostream&);
-using converter_func = std::function<void(const pugi::xml_node&, std::ostream&)>;
+template <typename Node>
+using basic_converter_func = std::function<void(const Node&, std::ostream&)>;
+using converter_func = basic_converter_func<pugi::xml_node>;
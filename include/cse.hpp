@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "pugixml.hpp"
+
+namespace cse
+{
+    template <typename Node>
+    struct temporary
+    {
+        std::string name;
+        Node expr; // the occurrence printed as the definition
+    };
+    // for a pugixml tree or a snapshot, keyed by node identity
+    template <typename Node>
+    struct basic_plan
+    {
+        // <ml:apply> occurrences printed as the name of a temporary
+        std::unordered_map<const void*, std::string> replaced;
+        // temporaries to define just before each <math> statement, in order
+        std::unordered_map<const void*, std::vector<temporary<Node>>> before;
+        std::size_t temporaries = 0;
+        std::size_t deduplicated = 0;
+    };
+    using plan = basic_plan<pugi::xml_node>;
+
+    // hash-conses the expressions of every <math> statement in the document and
+    // hoists repeated, pure, loop-invariant <ml:apply> subtrees into temporaries
+    // whenever (uses - 1) * size, the number of nodes saved, reaches threshold.
+    // instantiated for pugi::xml_node and snapshot::node
+    template <typename Node>
+    basic_plan<Node> analyze(const Node& document, std::size_t threshold);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "pugixml.hpp"
+#include "snapshot.hpp"
+
+namespace extract
+{
+    // decodes base64 from the front of in into out until in is used up, out
+    // has no room for another group of three bytes, or padding or a character
+    // outside the alphabet is reached; whitespace is skipped. in is advanced
+    // past what was decoded and the number of bytes written is returned.
+    // uses AVX2 or SSSE3 when the processor has them
+    std::size_t base64(std::string_view& in, char* out, std::size_t capacity);
+
+    // the decoders base64() picks from, fastest first
+    enum class kernel
+    {
+        avx2,
+        ssse3,
+        scalar,
+    };
+    // whether this build and processor can run k
+    bool supported(kernel k);
+    // as base64(), with the given supported decoder, so each can be tested
+    std::size_t base64(std::string_view& in, char* out, std::size_t capacity, kernel k);
+
+    // the file a binaryContent item is extracted to, named by its item-id and
+    // an extension recognised from the first decoded bytes; empty, and the
+    // item not extracted, if the item-id is not a plain file name
+    std::string file_name(const pugi::xml_node& item);
+    std::string file_name(const snapshot::node& item);
+    // the item of the worksheet's binaryContent with this item-id
+    pugi::xml_node find_item(const pugi::xml_node& doc, std::string_view id);
+    snapshot::node find_item(const snapshot::node& doc, std::string_view id);
+
+    // decodes every binaryContent item of doc into dir, a chunk at a time;
+    // returns false if any could not be decoded or written
+    bool items(const pugi::xml_node& doc, const std::filesystem::path& dir);
+
+    // runs items() on a thread of its own so that it overlaps the conversion
+    // of the same document, which only reads it too
+    class background
+    {
+    public:
+        background();
+        ~background();
+        background(const background&) = delete;
+        background& operator=(const background&) = delete;
+
+        void start(const pugi::xml_node& doc, std::filesystem::path dir);
+        // waits for the document last started; returns what items() did
+        bool wait();
+
+    private:
+        void run();
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        pugi::xml_node doc;
+        std::filesystem::path dir;
+        bool busy = false;
+        bool ok = true;
+        bool done = false;
+        std::thread thread;
+    };
+}
@@ -0,0 +1,70 @@
+#ifndef MATHCADCONVERT_H
+#define MATHCADCONVERT_H
+/* C interface to the converter, for embedding it in other programs and
+ * languages. All state lives in a context: calls on different contexts may
+ * run concurrently, calls on one context must not. */
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(MATHCADCONVERT_SHARED)
+#ifdef MATHCADCONVERT_BUILD
+#define MCC_API __declspec(dllexport)
+#else
+#define MCC_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define MCC_API __attribute__((visibility("default")))
+#else
+#define MCC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcc_context mcc_context;
+
+typedef enum mcc_status
+{
+	MCC_OK = 0,
+	MCC_INVALID_ARGUMENT,
+	MCC_PARSE_ERROR,
+	MCC_BUFFER_TOO_SMALL,
+	MCC_OUT_OF_MEMORY,
+	MCC_INTERNAL_ERROR
+} mcc_status;
+
+/* returns NULL when out of memory */
+MCC_API mcc_context *mcc_create(void);
+MCC_API void mcc_destroy(mcc_context *ctx);
+
+/* hoist repeated subexpressions into temporaries once (uses - 1) * size nodes
+ * would be saved; 0, the default, disables */
+MCC_API mcc_status mcc_set_cse_threshold(mcc_context *ctx, size_t threshold);
+/* the directory, relative to the script, that binaryContent items were
+ * extracted to for plots to refer to; NULL or "" when they were not */
+MCC_API mcc_status mcc_set_binary_dir(mcc_context *ctx, const char *dir);
+
+/* converts the worksheet in xml[0, size) into a script owned by ctx, valid
+ * until the next conversion with ctx or its destruction. the script is not
+ * NUL-terminated within script_size but is followed by a NUL */
+MCC_API mcc_status mcc_convert(mcc_context *ctx, const char *xml, size_t size, const char **script, size_t *script_size);
+/* as mcc_convert, copying the script into buffer. if capacity is too small,
+ * nothing is copied, *script_size is set to the capacity needed and
+ * MCC_BUFFER_TOO_SMALL returned; mcc_copy_script then copies it without
+ * converting again */
+MCC_API mcc_status mcc_convert_into(mcc_context *ctx, const char *xml, size_t size, char *buffer, size_t capacity, size_t *script_size);
+MCC_API mcc_status mcc_copy_script(const mcc_context *ctx, char *buffer, size_t capacity, size_t *script_size);
+
+/* the ids the last converted worksheet used without defining, sorted */
+MCC_API size_t mcc_undefined_id_count(const mcc_context *ctx);
+MCC_API const char *mcc_undefined_id(const mcc_context *ctx, size_t index);
+MCC_API void mcc_cse_stats(const mcc_context *ctx, size_t *temporaries, size_t *deduplicated);
+
+/* describes the last failure on ctx, or "" */
+MCC_API const char *mcc_last_error(const mcc_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
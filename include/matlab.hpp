@@ -1,10 +1,75 @@
 #pragma once
+#include <optional>
 #include <ostream>
 #include <set>
+#include <string>
+#include <string_view>
 #include "pugixml.hpp"
+#include "cse.hpp"
+#include "snapshot.hpp"
 
 namespace matlab
 {
+    // bump whenever the emitted text changes, so cached conversions are redone
+    inline constexpr int version = 1;
+
+    struct options
+    {
+        // hoist repeated subexpressions into temporaries once (uses - 1) * size
+        // nodes would be saved; 0 disables
+        std::size_t cse_threshold = 0;
+    };
+    struct cse_stats
+    {
+        std::size_t temporaries = 0;
+        std::size_t deduplicated = 0;
+    };
+
+    // everything one conversion reads and records, so that conversions with
+    // different contexts can run at the same time
+    struct context
+    {
+        context() = default;
+        explicit context(const options& opts) : opts(opts) {}
+
+        options opts;
+        // the directory, relative to the script, that the binaryContent items
+        // were extracted to for plots to refer to; empty when they were not
+        std::string binary_dir;
+
+        // of the last document converted
+        std::set<std::string> defined_ids;
+        std::set<std::string> undefined_ids;
+        // of the last document converted; reset it to tell whether one was
+        std::optional<cse_stats> stats;
+
+        // what depends on the kind of tree being converted
+        template <typename Node>
+        struct tree_state
+        {
+            cse::basic_plan<Node> plan;
+            // the temporary currently being defined, printed in full rather than by name
+            Node defining;
+        };
+        tree_state<pugi::xml_node> xml_tree;
+        tree_state<snapshot::node> snapshot_tree;
+
+        // converts node to os, recording into this context
+        void convert(const pugi::xml_node&, std::ostream&);
+        void convert(const snapshot::node&, std::ostream&);
+        std::optional<cse_stats> get_cse_stats() const;
+    };
+
+    // converts node as part of the conversion writing to os, which is how
+    // converters recurse; outside of one, a default context is used and
+    // dropped
     void convert(const pugi::xml_node&, std::ostream&);
-    std::set<std::string> get_undefined_ids();
+    void convert(const snapshot::node&, std::ostream&);
+    // whether the converter ignores elements of this name and everything in
+    // them, so snapshots can leave them out
+    bool skipped(std::string_view element);
+    // how an <ml:id> is spelled in the script, with its subscript after an
+    // underscore
+    std::string id_string(const pugi::xml_node&);
+    std::string id_string(const snapshot::node&);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+namespace output
+{
+    // replaces path with what write puts to the stream, through a temporary
+    // file beside it and a rename, so readers see either the old or the new
+    // contents; temporaries are named randomly, so threads and processes
+    // sharing a directory never collide. returns false if write does or the
+    // file could not be written
+    bool replace(const std::filesystem::path& path, const std::function<bool(std::ostream&)>& write);
+    bool replace(const std::filesystem::path& path, std::string_view contents);
+    // whether path names one of replace()'s temporaries
+    bool temporary(const std::filesystem::path& path);
+}
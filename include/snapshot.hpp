@@ -0,0 +1,184 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "pugixml.hpp"
+
+// a worksheet tree stored as flat tables that are used exactly as they are
+// mapped from disk, so converting it again needs no parsing
+namespace snapshot
+{
+    // bump whenever the layout below changes; older files are rejected
+    inline constexpr std::uint32_t version = 1;
+    inline constexpr std::string_view extension = ".mcsnap";
+
+    // offsets are relative to the record holding them, so the tables hold no
+    // addresses and need no fixing up; 0 means none
+    struct node_record
+    {
+        // in bytes, to NUL-terminated strings in the string table
+        std::int64_t name;
+        std::int64_t value;
+        // in bytes, to the first of attribute_count attribute_records
+        std::int64_t attributes;
+        // in node_records
+        std::int32_t parent;
+        std::int32_t first_child;
+        std::int32_t next_sibling;
+        std::uint16_t type; // a pugi::xml_node_type
+        std::uint16_t attribute_count;
+    };
+    struct attribute_record
+    {
+        std::int64_t name;
+        std::int64_t value;
+    };
+    struct header
+    {
+        char magic[8];
+        std::uint32_t version;
+        // 0x01020304 as written, so files from the other byte order are rejected
+        std::uint32_t byte_order;
+        std::uint64_t size;
+        // offsets from the start of the file, and lengths
+        std::uint64_t nodes, node_count;
+        std::uint64_t attributes, attribute_count;
+        std::uint64_t strings, string_bytes;
+    };
+    // the layout on disk; changing any of these needs a new version
+    static_assert(sizeof(node_record) == 40 && alignof(node_record) == 8);
+    static_assert(sizeof(attribute_record) == 16);
+    static_assert(sizeof(header) == 72);
+
+    template <typename Record>
+    const char* string_at(const Record* r, std::int64_t offset)
+    {
+        return reinterpret_cast<const char*>(r) + offset;
+    }
+
+    class node_attribute
+    {
+    public:
+        node_attribute() = default;
+        explicit node_attribute(const attribute_record* a) : a(a) {}
+        explicit operator bool() const { return a; }
+        bool operator!() const { return !a; }
+        const char* name() const { return a ? string_at(a, a->name) : ""; }
+        const char* value() const { return a ? string_at(a, a->value) : ""; }
+
+    private:
+        const attribute_record* a = nullptr;
+    };
+    class node_text
+    {
+    public:
+        explicit node_text(const char* s) : s(s) {}
+        const char* get() const { return s; }
+
+    private:
+        const char* s;
+    };
+
+    // the subset of pugi::xml_node the converters use, with the same meaning
+    class node
+    {
+    public:
+        node() = default;
+        explicit node(const node_record* r) : r(r) {}
+        explicit operator bool() const { return r; }
+        bool operator!() const { return !r; }
+        bool operator==(const node&) const = default;
+
+        pugi::xml_node_type type() const { return r ? static_cast<pugi::xml_node_type>(r->type) : pugi::node_null; }
+        const char* name() const { return r ? string_at(r, r->name) : ""; }
+        const char* value() const { return r ? string_at(r, r->value) : ""; }
+        node parent() const { return step(r ? r->parent : 0); }
+        node first_child() const { return step(r ? r->first_child : 0); }
+        node next_sibling() const { return step(r ? r->next_sibling : 0); }
+        node next_sibling(const char* name) const
+        {
+            auto n = next_sibling();
+            while (n && (n.type() != pugi::node_element || std::strcmp(n.name(), name) != 0))
+                n = n.next_sibling();
+            return n;
+        }
+        node child(const char* name) const
+        {
+            auto n = first_child();
+            if (n && (n.type() != pugi::node_element || std::strcmp(n.name(), name) != 0))
+                n = n.next_sibling(name);
+            return n;
+        }
+        node root() const
+        {
+            auto n = *this;
+            while (n.parent())
+                n = n.parent();
+            return n;
+        }
+        node_attribute attribute(const char* name) const
+        {
+            if (!r)
+                return {};
+            const auto* a = reinterpret_cast<const attribute_record*>(string_at(r, r->attributes));
+            for (unsigned i = 0; i < r->attribute_count; ++i)
+                if (std::strcmp(string_at(a + i, a[i].name), name) == 0)
+                    return node_attribute(a + i);
+            return {};
+        }
+        // the first text among the children, as pugi::xml_node::text()
+        node_text text() const
+        {
+            if (type() == pugi::node_pcdata || type() == pugi::node_cdata)
+                return node_text(value());
+            for (auto n = first_child(); n; n = n.next_sibling())
+                if (n.type() == pugi::node_pcdata || n.type() == pugi::node_cdata)
+                    return node_text(n.value());
+            return node_text("");
+        }
+        const void* internal_object() const { return r; }
+
+    private:
+        node step(std::int32_t offset) const { return offset ? node(r + offset) : node(); }
+
+        const node_record* r = nullptr;
+    };
+
+    // writes the tree below doc to path, leaving out the elements, and
+    // everything below them, that skip returns true for. binaryContent items
+    // keep only the start of their payload, which names their extracted files.
+    // returns false if path could not be written, or the tree has more nodes
+    // or attributes on one node than the format holds
+    bool write(const pugi::xml_node& doc, const std::string& path, const std::function<bool(std::string_view)>& skip);
+
+    // a snapshot mapped read-only, or read whole where mapping is unavailable
+    class file
+    {
+    public:
+        // checks the header and that the tables lie within the file; see error()
+        explicit file(const std::string& path);
+        ~file();
+        file(const file&) = delete;
+        file& operator=(const file&) = delete;
+
+        explicit operator bool() const { return message.empty(); }
+        const std::string& error() const { return message; }
+        // additionally checks every offset and string, for files that may be
+        // damaged; linear in the file but allocation free
+        bool verify();
+        node document() const;
+        std::size_t size() const { return length; }
+
+    private:
+        bool fail(std::string why);
+
+        const char* data = nullptr;
+        std::size_t length = 0;
+        bool mapped = false;
+        std::unique_ptr<std::uint64_t[]> owned;
+        std::string message;
+    };
+}
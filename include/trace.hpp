@@ -0,0 +1,31 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace trace
+{
+    // starts recording; every thread records into its own ring buffer and the
+    // spans are written to path as Chrome Trace Event JSON at exit
+    void enable(const std::string& path);
+    bool enabled();
+    // labels the calling thread in the timeline
+    void name_thread(std::string_view);
+
+    // records the time between construction and destruction, with an
+    // optional detail such as the file or region it covers
+    class span
+    {
+    public:
+        explicit span(const char* name, std::string_view detail = {});
+        ~span();
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+    private:
+        const char* name;
+        std::string_view detail;
+        std::int64_t start;
+    };
+}
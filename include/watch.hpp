@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include "cache.hpp"
+#include "matlab.hpp"
+
+namespace watch
+{
+    // converts the .xmcd files under dir whose output is missing or stale,
+    // then uses inotify to reconvert every worksheet that is created, written
+    // or renamed into the tree, until interrupted; returns the exit status
+    int run(const std::string& dir, const matlab::options&, unsigned jobs, cache::directory* cache = nullptr, bool extract = false);
+}
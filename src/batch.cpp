@@ -0,0 +1,238 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include "extract.hpp"
+#include "output.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+
+static pugi::xml_parse_result read(const std::string &path, std::vector<char> &contents)
+{
+	trace::span span("read", path);
+	pugi::xml_parse_result result;
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in)
+	{
+		result.status = pugi::status_file_not_found;
+		return result;
+	}
+	// a directory opens, and seeks to a nonsense end; pipes do not seek at all
+	std::error_code error;
+	const auto size = in.tellg();
+	if (!std::filesystem::is_regular_file(path, error) || size < 0)
+	{
+		result.status = pugi::status_io_error;
+		return result;
+	}
+	contents.resize(size);
+	in.seekg(0);
+	result.status = in.read(contents.data(), contents.size()) ? pugi::status_ok : pugi::status_io_error;
+	return result;
+}
+
+// records in a binary directory which input its items were extracted from,
+// and the files written, so that removed or changed items are noticed
+static constexpr std::string_view stamp_name = ".extracted";
+
+static bool extracted_from(const std::string &dir, std::uint64_t source)
+{
+	std::ifstream in(std::filesystem::path(dir) / stamp_name);
+	std::uint64_t stamped;
+	if (!(in >> std::hex >> stamped) || stamped != source)
+		return false;
+	std::string name;
+	std::uintmax_t size;
+	std::error_code error;
+	while (in >> name >> std::dec >> size)
+		if (std::filesystem::file_size(std::filesystem::path(dir) / name, error) != size || error)
+			return false;
+	return in.eof();
+}
+
+static void stamp(const std::string &dir, std::uint64_t source)
+{
+	std::ostringstream os;
+	os << std::hex << source << std::dec << '\n';
+	std::error_code error;
+	for (auto it = std::filesystem::directory_iterator(dir, error); !error && it != std::filesystem::directory_iterator(); it.increment(error))
+		if (it->path().filename() != stamp_name && it->is_regular_file(error))
+			os << it->path().filename().string() << ' ' << it->file_size(error) << '\n';
+	output::replace(std::filesystem::path(dir) / stamp_name, os.view());
+}
+
+static pugi::xml_parse_result convert_snapshot(const std::string &path, std::ostream &os, matlab::context &ctx, bool extract)
+{
+	pugi::xml_parse_result result;
+	snapshot::file file(path);
+	{
+		trace::span span("verify", path);
+		file.verify();
+	}
+	if (!file)
+	{
+		std::cerr << path << ": error: " << file.error() << '\n';
+		result.status = pugi::status_io_error;
+		return result;
+	}
+	const auto dir = batch::binary_dir(path);
+	const bool extracted = extract && std::filesystem::is_directory(dir);
+	if (extract && !extracted)
+		std::cerr << path << ": warning: a snapshot keeps no binaryContent to extract; convert the worksheet itself\n";
+	ctx.binary_dir = extracted ? std::filesystem::path(dir).filename().string() : std::string();
+
+	trace::span span("convert", path);
+	ctx.convert(file.document(), os);
+	for (auto &id : ctx.undefined_ids)
+		os << id << " = ?\n";
+	result.status = pugi::status_ok;
+	return result;
+}
+
+pugi::xml_parse_result batch::convert_file(const std::string &path, std::ostream &os, matlab::context &ctx, cache::directory *cache, bool extract)
+{
+	trace::span file("file", path);
+	// nothing is analyzed on a cache hit
+	ctx.stats.reset();
+	if (std::filesystem::path(path).extension() == snapshot::extension)
+		return convert_snapshot(path, os, ctx, extract);
+	const auto dir = extract ? binary_dir(path) : std::string();
+	std::vector<char> contents;
+	auto result = read(path, contents);
+	if (!result)
+		return result;
+
+	std::uint64_t key = 0, source = 0;
+	if (cache)
+	{
+		trace::span span("cache lookup", path);
+		key = cache->key({contents.data(), contents.size()});
+		// plots name the directory, which follows the file's name
+		if (extract)
+		{
+			source = cache::hash({contents.data(), contents.size()});
+			key = cache::hash(std::filesystem::path(dir).filename().string(), key);
+		}
+		std::vector<std::string> ids;
+		// a cached script can only refer to items extracted from this input
+		if ((!extract || extracted_from(dir, source)) && cache->load(key, contents.size(), os, ids))
+		{
+			for (auto &id : ids)
+				os << id << " = ?\n";
+			return result;
+		}
+	}
+
+	pugi::xml_document doc;
+	{
+		trace::span span("parse", path);
+		result = doc.load_buffer_inplace(contents.data(), contents.size());
+	}
+	if (!result)
+		return result;
+
+	// doc must outlive the extraction reading it, even if converting throws
+	struct extraction
+	{
+		extract::background *extractor = nullptr;
+		~extraction()
+		{
+			if (extractor)
+				extractor->wait();
+		}
+	} extracting;
+	if (extract)
+	{
+		thread_local extract::background extractor;
+		std::error_code error;
+		std::filesystem::remove(std::filesystem::path(dir) / stamp_name, error);
+		extractor.start(doc, dir);
+		extracting.extractor = &extractor;
+	}
+	ctx.binary_dir = extract ? std::filesystem::path(dir).filename().string() : std::string();
+
+	trace::span span("convert", path);
+	if (cache)
+	{
+		std::ostringstream script;
+		ctx.convert(doc, script);
+		cache->store(key, contents.size(), script.view(), ctx.undefined_ids);
+		os << script.view();
+	}
+	else
+		ctx.convert(doc, os);
+	if (extracting.extractor)
+	{
+		if (!std::exchange(extracting.extractor, nullptr)->wait())
+			std::cerr << path << ": warning: could not extract every binaryContent item\n";
+		else if (cache)
+			stamp(dir, source);
+	}
+	for (auto &id : ctx.undefined_ids)
+		os << id << " = ?\n";
+	return result;
+}
+
+std::string batch::output_path(const std::string &path)
+{
+	return std::filesystem::path(path).replace_extension(".m").string();
+}
+
+std::string batch::binary_dir(const std::string &path)
+{
+	auto dir = std::filesystem::path(path).replace_extension();
+	dir += "_files";
+	return dir.string();
+}
+
+int batch::run(const std::vector<std::string> &files, const matlab::options &options, unsigned jobs, cache::directory *cache, bool extract)
+{
+	std::atomic<std::size_t> next = 0;
+	std::atomic<int> status = 0;
+	std::mutex errors;
+	const auto worker = [&](unsigned n)
+	{
+		trace::name_thread("worker " + std::to_string(n));
+		matlab::context ctx(options);
+		for (std::size_t i; (i = next++) < files.size();)
+		{
+			std::ostringstream os;
+			auto result = convert_file(files[i], os, ctx, cache, extract);
+			if (!result)
+			{
+				std::lock_guard lock(errors);
+				std::cerr << files[i] << ": error: " << result.description() << '\n';
+				status = 2;
+				continue;
+			}
+
+			trace::span span("flush", files[i]);
+			const auto path = output_path(files[i]);
+			if (!output::replace(path, os.view()))
+			{
+				std::lock_guard lock(errors);
+				std::cerr << path << ": error: could not write\n";
+				status = 2;
+			}
+			else if (const auto stats = ctx.get_cse_stats(); stats && options.cse_threshold)
+			{
+				std::lock_guard lock(errors);
+				std::cerr << files[i] << ": " << stats->temporaries << " temporaries, " << stats->deduplicated << " nodes deduplicated\n";
+			}
+		}
+	};
+
+	jobs = std::clamp<unsigned>(jobs, 1, std::max<std::size_t>(files.size(), 1));
+	std::vector<std::thread> threads;
+	for (unsigned n = 1; n <= jobs; ++n)
+		threads.emplace_back(worker, n);
+	for (auto &t : threads)
+		t.join();
+	return status;
+}
@@ -0,0 +1,202 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "output.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr std::string_view magic = "mathcadconvert cache 1";
+// temporary files older than this were left by writers that died
+static constexpr std::chrono::hours stale(1);
+
+static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87;
+static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4F;
+static constexpr std::uint64_t prime3 = 0x165667B19E3779F9;
+static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63;
+static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5;
+
+// little-endian reads, as XXH64 is defined
+static std::uint64_t read64(const char *p)
+{
+	std::uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+static std::uint32_t read32(const char *p)
+{
+	std::uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+static std::uint64_t rotl(std::uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+static std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t input)
+{
+	return rotl(acc + input * prime2, 31) * prime1;
+}
+static std::uint64_t merge(std::uint64_t acc, std::uint64_t v)
+{
+	return (acc ^ xxh_round(0, v)) * prime1 + prime4;
+}
+
+std::uint64_t cache::hash(std::string_view data, std::uint64_t seed)
+{
+	const char *p = data.data();
+	const char *const end = p + data.size();
+	std::uint64_t h;
+	if (data.size() >= 32)
+	{
+		std::uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+	}
+	else
+		h = seed + prime5;
+	h += data.size();
+	for (; p + 8 <= end; p += 8)
+		h = rotl(h ^ xxh_round(0, read64(p)), 27) * prime1 + prime4;
+	if (p + 4 <= end)
+	{
+		h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = rotl(h ^ (static_cast<unsigned char>(*p) * prime5), 11) * prime1;
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+cache::directory::directory(fs::path root, std::uintmax_t max_bytes, std::string_view settings)
+	: root(std::move(root)), max_bytes(max_bytes), seed(hash(settings)), size(0)
+{
+	std::error_code error;
+	fs::create_directories(this->root, error);
+	evict();
+}
+
+std::uint64_t cache::directory::key(std::string_view input) const
+{
+	return hash(input, seed);
+}
+
+fs::path cache::directory::entry(std::uint64_t key) const
+{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+	// fan out so no single directory grows too large
+	return root / std::string_view(name, 2) / name;
+}
+
+bool cache::directory::load(std::uint64_t key, std::size_t input_size, std::ostream &os, std::vector<std::string> &undefined_ids) const
+{
+	const auto path = entry(key);
+	std::ifstream in(path, std::ios::binary);
+	std::string line;
+	if (!in || !std::getline(in, line) || line != magic)
+		return false;
+	std::uintmax_t size, count, script_size;
+	if (!(in >> size >> count >> script_size) || in.get() != '\n' || size != input_size)
+		return false;
+	std::vector<std::string> ids;
+	for (; count && std::getline(in, line); --count)
+		ids.push_back(std::move(line));
+	if (count)
+		return false;
+	// entries only appear complete, but never stream a damaged one
+	const auto start = in.tellg();
+	in.seekg(0, std::ios::end);
+	if (std::uintmax_t(in.tellg() - start) != script_size)
+		return false;
+	in.seekg(start);
+	if (script_size)
+		os << in.rdbuf();
+
+	undefined_ids = std::move(ids);
+	// the modification time orders entries for eviction
+	std::error_code error;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+	return true;
+}
+
+void cache::directory::store(std::uint64_t key, std::size_t input_size, std::string_view script, const std::set<std::string> &undefined_ids)
+{
+	std::ostringstream header;
+	header << magic << '\n'
+				 << input_size << ' ' << undefined_ids.size() << ' ' << script.size() << '\n';
+	for (auto &id : undefined_ids)
+		header << id << '\n';
+
+	const auto path = entry(key);
+	std::error_code error;
+	fs::create_directories(path.parent_path(), error);
+	const auto h = header.view();
+	if (!output::replace(path, [&](std::ostream &out) { return bool(out.write(h.data(), h.size()).write(script.data(), script.size())); }))
+		return;
+	if ((size += header.view().size() + script.size()) > max_bytes)
+		evict();
+}
+
+void cache::directory::evict()
+{
+	// one eviction at a time; others keep converting rather than queue up
+	std::unique_lock lock(evicting, std::try_to_lock);
+	if (!lock)
+		return;
+
+	struct file
+	{
+		fs::file_time_type time;
+		std::uintmax_t size;
+		fs::path path;
+	};
+	std::vector<file> files;
+	std::uintmax_t total = 0;
+	std::error_code error;
+	for (auto it = fs::recursive_directory_iterator(root, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+	{
+		std::error_code e;
+		if (!it->is_regular_file(e))
+			continue;
+		const auto time = it->last_write_time(e);
+		// another writer's entry in progress; only clear up after crashed ones
+		if (output::temporary(it->path()))
+		{
+			if (time < fs::file_time_type::clock::now() - stale)
+				fs::remove(it->path(), e);
+			continue;
+		}
+		const auto bytes = it->file_size(e);
+		files.push_back({time, bytes, it->path()});
+		total += bytes;
+	}
+	if (total > max_bytes)
+	{
+		std::sort(files.begin(), files.end(), [](const file &a, const file &b) { return a.time < b.time; });
+		for (auto &f : files)
+		{
+			if (total <= max_bytes / 10 * 9)
+				break;
+			// entries being read stay readable through their open handle
+			if (fs::remove(f.path, error))
+				total -= f.size;
+		}
+	}
+	size = total;
+}
@@ -0,0 +1,523 @@
+#include "check.hpp"
+#include "matlab.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <functional>
+#include <numbers>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+using sv = std::string_view;
+using complex = std::complex<double>;
+// scalars are one element long; ranges and vectors hold their elements in order
+using value = std::vector<complex>;
+
+namespace
+{
+	struct error : std::runtime_error
+	{
+		using std::runtime_error::runtime_error;
+	};
+	struct function
+	{
+		std::vector<std::string> params;
+		pugi::xml_node body;
+	};
+	struct environment
+	{
+		std::unordered_map<std::string, value> vars;
+		std::unordered_map<std::string, function> funcs;
+		const std::unordered_map<std::string, value> *locals = nullptr;
+		int depth = 0;
+		double tolerance;
+		double zero;
+		std::string region;
+		check::report report;
+	};
+}
+
+static value evaluate(const pugi::xml_node &node, environment &env);
+
+static std::string to_string(const value &v)
+{
+	std::ostringstream os;
+	os.precision(15);
+	if (v.size() != 1)
+		os << '[';
+	for (size_t i = 0; i < v.size(); ++i)
+	{
+		if (i)
+			os << ", ";
+		os << v[i].real();
+		if (v[i].imag() != 0)
+			os << (v[i].imag() < 0 ? " - " : " + ") << std::abs(v[i].imag()) << 'i';
+	}
+	if (v.size() != 1)
+		os << ']';
+	return os.str();
+}
+static const complex &scalar(const value &v)
+{
+	if (v.size() != 1)
+		throw error("expected a scalar, got " + std::to_string(v.size()) + " elements");
+	return v.front();
+}
+
+// element-wise operation, broadcasting scalars against vectors
+template <typename F>
+static value elementwise(const value &a, const value &b, F f)
+{
+	if (a.size() != b.size() && a.size() != 1 && b.size() != 1)
+		throw error("size mismatch " + std::to_string(a.size()) + " vs " + std::to_string(b.size()));
+	value r(std::max(a.size(), b.size()));
+	for (size_t i = 0; i < r.size(); ++i)
+		r[i] = f(a[a.size() == 1 ? 0 : i], b[b.size() == 1 ? 0 : i]);
+	return r;
+}
+template <typename F>
+static value elementwise(const value &a, F f)
+{
+	value r(a.size());
+	std::transform(a.begin(), a.end(), r.begin(), f);
+	return r;
+}
+static complex power(complex a, complex b)
+{
+	// stay on the real line where possible so integer powers are exact
+	if (a.imag() == 0 && b.imag() == 0 && (a.real() >= 0 || b.real() == std::round(b.real())))
+		return std::pow(a.real(), b.real());
+	return std::pow(a, b);
+}
+
+// SI scale of Mathcad unit names; results are stored in base units
+static const std::unordered_map<sv, double> units = {
+		{"m", 1},
+		{"cm", 1e-2},
+		{"mm", 1e-3},
+		{"μm", 1e-6},
+		{"km", 1e3},
+		{"in", 0.0254},
+		{"ft", 0.3048},
+		{"s", 1},
+		{"ms", 1e-3},
+		{"μs", 1e-6},
+		{"ns", 1e-9},
+		{"min", 60},
+		{"hr", 3600},
+		{"kg", 1},
+		{"gm", 1e-3},
+		{"lb", 0.45359237},
+		{"A", 1},
+		{"mA", 1e-3},
+		{"μA", 1e-6},
+		{"kA", 1e3},
+		{"V", 1},
+		{"mV", 1e-3},
+		{"μV", 1e-6},
+		{"kV", 1e3},
+		{"W", 1},
+		{"mW", 1e-3},
+		{"kW", 1e3},
+		{"MW", 1e6},
+		{"Ω", 1},
+		{"mΩ", 1e-3},
+		{"kΩ", 1e3},
+		{"MΩ", 1e6},
+		{"Hz", 1},
+		{"kHz", 1e3},
+		{"MHz", 1e6},
+		{"GHz", 1e9},
+		{"F", 1},
+		{"μF", 1e-6},
+		{"nF", 1e-9},
+		{"pF", 1e-12},
+		{"H", 1},
+		{"mH", 1e-3},
+		{"μH", 1e-6},
+		{"C", 1},
+		{"N", 1},
+		{"kN", 1e3},
+		{"Pa", 1},
+		{"kPa", 1e3},
+		{"MPa", 1e6},
+		{"J", 1},
+		{"kJ", 1e3},
+		{"K", 1},
+		{"rad", 1},
+		{"deg", std::numbers::pi / 180},
+		{"°", std::numbers::pi / 180},
+		{"%", 1e-2},
+};
+// unitReference names, as written in results
+static const std::unordered_map<sv, double> unit_references = {
+		{"meter", 1},
+		{"second", 1},
+		{"kilogram", 1},
+		{"ampere", 1},
+		{"kelvin", 1},
+		{"mole", 1},
+		{"candela", 1},
+		{"radian", 1},
+		{"steradian", 1},
+		{"degree", std::numbers::pi / 180},
+};
+static const std::unordered_map<sv, complex> constants = {
+		{"π", std::numbers::pi},
+		{"e", std::numbers::e},
+		{"g", 9.80665},
+};
+
+static complex principal_sqrt(complex c)
+{
+	return c.imag() == 0 && c.real() >= 0 ? complex(std::sqrt(c.real())) : std::sqrt(c);
+}
+static complex magnitude(complex c)
+{
+	return std::abs(c);
+}
+
+using builtin = std::function<value(const std::vector<value> &)>;
+template <typename F>
+static builtin unary(F f)
+{
+	return [f](const std::vector<value> &args) {
+		if (args.size() != 1)
+			throw error("expected one argument");
+		return elementwise(args[0], f);
+	};
+}
+static value extreme(const std::vector<value> &args, bool largest)
+{
+	value all;
+	for (auto &a : args)
+		all.insert(all.end(), a.begin(), a.end());
+	if (all.empty())
+		throw error("expected at least one argument");
+	const auto less = [](const complex &a, const complex &b) { return a.real() < b.real(); };
+	return {largest ? *std::max_element(all.begin(), all.end(), less) : *std::min_element(all.begin(), all.end(), less)};
+}
+static const std::unordered_map<sv, builtin> builtins = {
+		{"sin", unary([](complex c) { return std::sin(c); })},
+		{"cos", unary([](complex c) { return std::cos(c); })},
+		{"tan", unary([](complex c) { return std::tan(c); })},
+		{"asin", unary([](complex c) { return std::asin(c); })},
+		{"acos", unary([](complex c) { return std::acos(c); })},
+		{"atan", unary([](complex c) { return std::atan(c); })},
+		{"sinh", unary([](complex c) { return std::sinh(c); })},
+		{"cosh", unary([](complex c) { return std::cosh(c); })},
+		{"tanh", unary([](complex c) { return std::tanh(c); })},
+		{"exp", unary([](complex c) { return std::exp(c); })},
+		{"ln", unary([](complex c) { return c.imag() == 0 && c.real() > 0 ? complex(std::log(c.real())) : std::log(c); })},
+		{"log", unary([](complex c) { return c.imag() == 0 && c.real() > 0 ? complex(std::log10(c.real())) : std::log10(c); })},
+		{"sqrt", unary(principal_sqrt)},
+		{"abs", unary(magnitude)},
+		{"Re", unary([](complex c) { return complex(c.real()); })},
+		{"Im", unary([](complex c) { return complex(c.imag()); })},
+		{"floor", unary([](complex c) { return complex(std::floor(c.real())); })},
+		{"ceil", unary([](complex c) { return complex(std::ceil(c.real())); })},
+		{"round", unary([](complex c) { return complex(std::round(c.real())); })},
+		{"max", [](const std::vector<value> &args) { return extreme(args, true); }},
+		{"min", [](const std::vector<value> &args) { return extreme(args, false); }},
+		{"mod", [](const std::vector<value> &args) {
+			 if (args.size() != 2)
+				 throw error("expected two arguments");
+			 return elementwise(args[0], args[1], [](complex a, complex b) { return complex(std::fmod(a.real(), b.real())); });
+		 }},
+};
+
+// arguments are either siblings or wrapped in a single <ml:sequence>
+static std::vector<value> arguments(pugi::xml_node arg, environment &env)
+{
+	if (arg && !arg.next_sibling() && sv(arg.name()) == "ml:sequence")
+		arg = arg.first_child();
+	std::vector<value> args;
+	for (; arg; arg = arg.next_sibling())
+		args.push_back(evaluate(arg, env));
+	return args;
+}
+static value call(const std::string &name, const pugi::xml_node &args, environment &env)
+{
+	if (name == "if")
+	{
+		auto arg = args;
+		if (sv(arg.name()) == "ml:sequence")
+			arg = arg.first_child();
+		const auto then = arg.next_sibling();
+		if (!then || !then.next_sibling())
+			throw error("if expects three arguments");
+		// only the selected branch is evaluated, like Mathcad
+		return evaluate(scalar(evaluate(arg, env)).real() != 0 ? then : then.next_sibling(), env);
+	}
+	if (auto f = env.funcs.find(name); f != env.funcs.end())
+	{
+		auto values = arguments(args, env);
+		if (values.size() != f->second.params.size())
+			throw error(name + " expects " + std::to_string(f->second.params.size()) + " arguments");
+		if (env.depth > 256)
+			throw error("recursion too deep in " + name);
+		std::unordered_map<std::string, value> locals;
+		for (size_t i = 0; i < values.size(); ++i)
+			locals[f->second.params[i]] = std::move(values[i]);
+		const auto outer = env.locals;
+		env.locals = &locals;
+		++env.depth;
+		struct restore
+		{
+			environment &env;
+			decltype(outer) locals;
+			~restore()
+			{
+				env.locals = locals;
+				--env.depth;
+			}
+		} guard{env, outer};
+		return evaluate(f->second.body, env);
+	}
+	if (auto f = builtins.find(name); f != builtins.end())
+		return f->second(arguments(args, env));
+	throw error("unknown function '" + name + "'");
+}
+
+static value real(const pugi::xml_node &node, environment &)
+{
+	return {std::strtod(node.text().get(), nullptr)};
+}
+static value imag(const pugi::xml_node &node, environment &)
+{
+	return {complex(0, std::strtod(node.text().get(), nullptr))};
+}
+static value id(const pugi::xml_node &node, environment &env)
+{
+	const auto name = matlab::id_string(node);
+	if (env.locals)
+		if (auto v = env.locals->find(name); v != env.locals->end())
+			return v->second;
+	if (auto v = env.vars.find(name); v != env.vars.end())
+		return v->second;
+	if (auto c = constants.find(name); c != constants.end())
+		return {c->second};
+	if (auto u = units.find(name); u != units.end())
+		return {u->second};
+	throw error("'" + name + "' is not defined");
+}
+static value first(const pugi::xml_node &node, environment &env)
+{
+	return evaluate(node.first_child(), env);
+}
+static value product(const pugi::xml_node &node, environment &env)
+{
+	value r{1};
+	for (auto child = node.first_child(); child; child = child.next_sibling())
+		r = elementwise(r, evaluate(child, env), std::multiplies<complex>());
+	return r;
+}
+static value unitReference(const pugi::xml_node &node, environment &)
+{
+	const sv unit = node.attribute("unit").value();
+	const auto u = unit_references.find(unit);
+	if (u == unit_references.end())
+		throw error("unknown unit '" + std::string(unit) + "'");
+	const auto num = node.attribute("power-numerator");
+	const auto den = node.attribute("power-denominator");
+	const double p = (num ? std::strtod(num.value(), nullptr) : 1) / (den ? std::strtod(den.value(), nullptr) : 1);
+	return {std::pow(u->second, p)};
+}
+static value range(const pugi::xml_node &node, environment &env)
+{
+	// <ml:range> holds first..last, or a <ml:sequence> of first, second..last
+	auto a = node.first_child();
+	const auto last = scalar(evaluate(a.next_sibling(), env)).real();
+	double start, step;
+	if (sv(a.name()) == "ml:sequence")
+	{
+		start = scalar(evaluate(a.first_child(), env)).real();
+		step = scalar(evaluate(a.first_child().next_sibling(), env)).real() - start;
+	}
+	else
+	{
+		start = scalar(evaluate(a, env)).real();
+		step = last >= start ? 1 : -1;
+	}
+	if (step == 0 || (last - start) / step > 1e7)
+		throw error("invalid range");
+	value r;
+	for (double x = start; step > 0 ? x <= last + 1e-12 : x >= last - 1e-12; x = start + step * double(r.size()))
+		r.push_back(x);
+	return r;
+}
+static value matrix(const pugi::xml_node &node, environment &env)
+{
+	value r;
+	for (auto child = node.first_child(); child; child = child.next_sibling())
+	{
+		auto v = evaluate(child, env);
+		r.insert(r.end(), v.begin(), v.end());
+	}
+	return r;
+}
+static value apply(const pugi::xml_node &node, environment &env)
+{
+	const auto f = node.first_child();
+	const auto fname = sv(f.name());
+	if (fname == "ml:id")
+		return call(matlab::id_string(f), f.next_sibling(), env);
+
+	const auto a = f.next_sibling();
+	if (!a)
+		throw error("'apply' contains <" + std::string(fname) + "> and no other tags");
+	const auto b = a.next_sibling();
+	if (!b)
+	{
+		const auto v = evaluate(a, env);
+		if (fname == "ml:neg")
+			return elementwise(v, std::negate<complex>());
+		if (fname == "ml:sqrt")
+			return elementwise(v, principal_sqrt);
+		if (fname == "ml:absval")
+			return elementwise(v, magnitude);
+		throw error("unsupported operator <" + std::string(fname) + ">");
+	}
+	if (b.next_sibling())
+		throw error("unsupported operator <" + std::string(fname) + "> with three or more arguments");
+
+	const auto lhs = evaluate(a, env);
+	if (fname == "ml:indexer")
+	{
+		// Mathcad's ORIGIN defaults to 0
+		return elementwise(evaluate(b, env), [&lhs](complex i) {
+			const auto n = std::llround(i.real());
+			if (n < 0 || size_t(n) >= lhs.size())
+				throw error("index " + std::to_string(n) + " out of range");
+			return lhs[n];
+		});
+	}
+	const auto rhs = evaluate(b, env);
+	if (fname == "ml:plus")
+		return elementwise(lhs, rhs, std::plus<complex>());
+	if (fname == "ml:minus")
+		return elementwise(lhs, rhs, std::minus<complex>());
+	if (fname == "ml:mult")
+		return elementwise(lhs, rhs, std::multiplies<complex>());
+	if (fname == "ml:div")
+		return elementwise(lhs, rhs, std::divides<complex>());
+	if (fname == "ml:pow")
+		return elementwise(lhs, rhs, power);
+	if (fname == "ml:equal")
+		return elementwise(lhs, rhs, [](complex x, complex y) { return complex(x == y); });
+	if (fname == "ml:greaterThan")
+		return elementwise(lhs, rhs, [](complex x, complex y) { return complex(x.real() > y.real()); });
+	if (fname == "ml:lessThan")
+		return elementwise(lhs, rhs, [](complex x, complex y) { return complex(x.real() < y.real()); });
+	throw error("unsupported operator <" + std::string(fname) + ">");
+}
+static bool within_tolerance(const value &a, const value &b, double tolerance, double zero)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		if (std::abs(a[i] - b[i]) > std::max(tolerance * std::max(std::abs(a[i]), std::abs(b[i])), zero))
+			return false;
+	return true;
+}
+// evaluates the expression and compares it to the stored <result>
+static value eval(const pugi::xml_node &node, environment &env)
+{
+	const auto expected = node.child("result");
+	if (!expected)
+		return evaluate(node.first_child(), env);
+
+	++env.report.checked;
+	std::string want = "?";
+	try
+	{
+		const auto expected_value = evaluate(expected.first_child(), env);
+		want = to_string(expected_value);
+		auto got = evaluate(node.first_child(), env);
+		if (!within_tolerance(got, expected_value, env.tolerance, env.zero))
+			env.report.mismatches.push_back({env.region, want, to_string(got)});
+		return got;
+	}
+	catch (const error &e)
+	{
+		env.report.mismatches.push_back({env.region, want, std::string("error: ") + e.what()});
+		throw;
+	}
+}
+static value define(const pugi::xml_node &node, environment &env)
+{
+	const auto lhs = node.first_child();
+	const auto rhs = lhs.next_sibling();
+	const auto fname = sv(lhs.name());
+	if (fname == "ml:id")
+		return env.vars[matlab::id_string(lhs)] = evaluate(rhs, env);
+	if (fname == "ml:function")
+	{
+		function f{{}, rhs};
+		for (auto var = lhs.child("ml:boundVars").first_child(); var; var = var.next_sibling())
+			f.params.push_back(matlab::id_string(var));
+		env.funcs[matlab::id_string(lhs.first_child())] = std::move(f);
+		return {};
+	}
+	throw error("unsupported definition of <" + std::string(fname) + ">");
+}
+
+static const std::unordered_map<sv, value (*)(const pugi::xml_node &, environment &)> eval_funcs = {
+		{"ml:real", real},
+		{"ml:imag", imag},
+		{"ml:id", id},
+		{"ml:parens", first},
+		{"ml:apply", apply},
+		{"ml:range", range},
+		{"ml:matrix", matrix},
+		{"ml:eval", eval},
+		{"ml:define", define},
+		{"unitedValue", product},
+		{"unitMonomial", product},
+		{"unitReference", unitReference},
+};
+
+static value evaluate(const pugi::xml_node &node, environment &env)
+{
+	if (auto func = eval_funcs.find(node.name()); func != eval_funcs.end())
+		return func->second(node, env);
+	throw error("cannot evaluate <" + std::string(node.name()) + ">");
+}
+static void regions(const pugi::xml_node &node, environment &env)
+{
+	for (auto child = node.first_child(); child; child = child.next_sibling())
+	{
+		if (child.type() != pugi::xml_node_type::node_element)
+			continue;
+		const auto name = sv(child.name());
+		if (name == "region")
+			env.region = child.attribute("region-id").value();
+		if (name == "math")
+		{
+			// a failed definition leaves its id undefined; anything depending
+			// on it is reported where it is checked
+			try
+			{
+				evaluate(child.first_child(), env);
+			}
+			catch (const error &)
+			{
+			}
+			continue;
+		}
+		if (name == "binaryContent" || name == "settings")
+			continue;
+		regions(child, env);
+	}
+}
+
+check::report check::worksheet(const pugi::xml_node &node, double tolerance, double zero)
+{
+	environment env;
+	env.tolerance = tolerance;
+	env.zero = zero;
+	regions(node, env);
+	return std::move(env.report);
+}
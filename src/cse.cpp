@@ -0,0 +1,241 @@
+#include "cse.hpp"
+#include "matlab.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string_view>
+#include <unordered_set>
+
+using sv = std::string_view;
+
+namespace
+{
+	// one structurally unique expression
+	template <typename Node>
+	struct entry
+	{
+		std::size_t size = 1;
+		bool pure = true;
+		bool invariant = true;
+		// index of the first statement at which every dependency is defined
+		std::size_t position = 0;
+		std::vector<Node> uses;
+	};
+	struct definition
+	{
+		std::size_t generation = 0;
+		std::size_t position = 0;
+		bool invariant = true;
+	};
+	template <typename Node>
+	struct state
+	{
+		// hash-cons table: structural key -> index into entries
+		std::unordered_map<std::string, std::size_t> table;
+		std::vector<entry<Node>> entries;
+		// latest definition of each id; redefinitions bump the generation so
+		// uses on either side of them never share an entry
+		std::unordered_map<std::string, definition> defs;
+		const std::set<std::string> *bound = nullptr;
+		std::set<std::string> names;
+		std::vector<Node> statements;
+	};
+}
+
+// functions whose result differs between calls
+static const std::set<sv> impure = {"rnd", "runif", "rnorm", "time"};
+// attributes that change the emitted text
+static const char *const printed_attributes[] = {"subscript", "symbol", "unit", "power-numerator", "power-denominator"};
+
+template <typename Node>
+static std::size_t intern(const Node &node, state<Node> &s)
+{
+	const auto name = sv(node.name());
+	entry<Node> e;
+	std::string key(name);
+	key += '\x1f';
+	key += node.text().get();
+	for (auto attribute : printed_attributes)
+	{
+		key += '\x1f';
+		key += node.attribute(attribute).value();
+	}
+	if (name == "ml:id")
+	{
+		const auto id = matlab::id_string(node);
+		s.names.insert(id);
+		if (s.bound && s.bound->contains(id))
+		{
+			key += "\x1f" "bound";
+			e.invariant = false;
+		}
+		else if (auto d = s.defs.find(id); d != s.defs.end())
+		{
+			key += '\x1f' + std::to_string(d->second.generation);
+			e.position = d->second.position;
+			e.invariant = d->second.invariant;
+		}
+	}
+	if (name == "ml:range")
+		e.invariant = false;
+	if (name == "ml:apply")
+	{
+		const auto f = node.first_child();
+		if (sv(f.name()) == "ml:Find" || (sv(f.name()) == "ml:id" && impure.contains(f.text().get())))
+			e.pure = false;
+	}
+	for (auto child = node.first_child(); child; child = child.next_sibling())
+	{
+		if (child.type() != pugi::xml_node_type::node_element)
+			continue;
+		const auto c = intern(child, s);
+		key += ',' + std::to_string(c);
+		const auto &ce = s.entries[c];
+		e.size += ce.size;
+		e.pure &= ce.pure;
+		e.invariant &= ce.invariant;
+		e.position = std::max(e.position, ce.position);
+	}
+	const auto [it, inserted] = s.table.try_emplace(std::move(key), s.entries.size());
+	if (inserted)
+		s.entries.push_back(std::move(e));
+	if (name == "ml:apply")
+		s.entries[it->second].uses.push_back(node);
+	return it->second;
+}
+template <typename Node>
+static std::size_t expression(const Node &node, state<Node> &s)
+{
+	// only the expression of an eval is emitted, not its stored result
+	if (sv(node.name()) == "ml:eval")
+		return intern(node.first_child(), s);
+	return intern(node, s);
+}
+template <typename Node>
+static void statement(const Node &math, state<Node> &s)
+{
+	const auto position = s.statements.size();
+	s.statements.push_back(math);
+	const auto stmt = math.first_child();
+	if (sv(stmt.name()) != "ml:define")
+	{
+		expression(stmt, s);
+		return;
+	}
+
+	const auto lhs = stmt.first_child();
+	const auto rhs = lhs.next_sibling();
+	const auto lname = sv(lhs.name());
+	std::string defined;
+	bool invariant = true;
+	if (lname == "ml:id")
+	{
+		defined = matlab::id_string(lhs);
+		invariant = s.entries[expression(rhs, s)].invariant;
+	}
+	else if (lname == "ml:function")
+	{
+		defined = matlab::id_string(lhs.first_child());
+		std::set<std::string> bound;
+		for (auto var = lhs.child("ml:boundVars").first_child(); var; var = var.next_sibling())
+			bound.insert(matlab::id_string(var));
+		s.bound = &bound;
+		expression(rhs, s);
+		s.bound = nullptr;
+	}
+	else
+	{
+		// element assignment such as x[n := ..., defines x over a range
+		if (lname == "ml:apply" && sv(lhs.first_child().name()) == "ml:indexer")
+			defined = matlab::id_string(lhs.first_child().next_sibling());
+		invariant = false;
+		expression(rhs, s);
+	}
+	if (defined.empty())
+		return;
+	s.names.insert(defined);
+	auto &d = s.defs[defined];
+	++d.generation;
+	d.position = position + 1;
+	d.invariant = invariant;
+}
+template <typename Node>
+static void walk(const Node &node, state<Node> &s)
+{
+	for (auto child = node.first_child(); child; child = child.next_sibling())
+	{
+		if (child.type() != pugi::xml_node_type::node_element)
+			continue;
+		if (sv(child.name()) == "math")
+			statement(child, s);
+		else
+			walk(child, s);
+	}
+}
+
+// an occurrence is still printed unless it sits inside another replaced
+// occurrence; the first occurrence of a temporary is printed in its definition
+template <typename Node>
+static bool emitted(const Node &use, const cse::basic_plan<Node> &p, const std::unordered_set<const void *> &definitions)
+{
+	for (auto a = use.parent(); a; a = a.parent())
+		if (p.replaced.contains(a.internal_object()))
+			return definitions.contains(a.internal_object());
+	return true;
+}
+
+template <typename Node>
+cse::basic_plan<Node> cse::analyze(const Node &document, std::size_t threshold)
+{
+	state<Node> s;
+	walk(document, s);
+
+	std::vector<std::size_t> candidates;
+	for (std::size_t i = 0; i < s.entries.size(); ++i)
+	{
+		const auto &e = s.entries[i];
+		if (e.uses.size() > 1 && e.pure && e.invariant && (e.uses.size() - 1) * e.size >= threshold)
+			candidates.push_back(i);
+	}
+	// outer expressions first, so inner ones only count the uses left printed
+	std::stable_sort(candidates.begin(), candidates.end(), [&s](std::size_t a, std::size_t b) { return s.entries[a].size > s.entries[b].size; });
+
+	basic_plan<Node> p;
+	std::unordered_set<const void *> definitions;
+	std::map<std::size_t, std::vector<std::pair<std::size_t, temporary<Node>>>> slots;
+	std::size_t counter = 0;
+	for (const auto c : candidates)
+	{
+		const auto &e = s.entries[c];
+		std::vector<Node> uses;
+		for (const auto &use : e.uses)
+			if (emitted(use, p, definitions))
+				uses.push_back(use);
+		if (uses.size() < 2 || (uses.size() - 1) * e.size < threshold)
+			continue;
+
+		std::string name;
+		do
+			name = "cse" + std::to_string(++counter);
+		while (s.names.contains(name));
+		for (const auto &use : uses)
+			p.replaced[use.internal_object()] = name;
+		definitions.insert(uses.front().internal_object());
+		slots[e.position].push_back({e.size, {name, uses.front()}});
+		++p.temporaries;
+		p.deduplicated += (uses.size() - 1) * e.size;
+	}
+	for (auto &[position, temps] : slots)
+	{
+		// a temporary can only contain smaller ones, so define those first
+		std::stable_sort(temps.begin(), temps.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+		auto &before = p.before[s.statements[position].internal_object()];
+		for (auto &t : temps)
+			before.push_back(std::move(t.second));
+	}
+	return p;
+}
+
+template cse::basic_plan<pugi::xml_node> cse::analyze(const pugi::xml_node &, std::size_t);
+template cse::basic_plan<snapshot::node> cse::analyze(const snapshot::node &, std::size_t);
@@ -0,0 +1,355 @@
+#include "extract.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include "trace.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define EXTRACT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// decoded bytes are written out this many at a time
+static constexpr std::size_t chunk = 64 * 1024;
+
+// sextet of each character, 0x40 for whitespace and 0x80 for anything else
+static constexpr auto sextets = []
+{
+	std::array<unsigned char, 256> t{};
+	t.fill(0x80);
+	constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (std::size_t i = 0; i < alphabet.size(); ++i)
+		t[static_cast<unsigned char>(alphabet[i])] = static_cast<unsigned char>(i);
+	for (const char c : {' ', '\t', '\r', '\n'})
+		t[static_cast<unsigned char>(c)] = 0x40;
+	return t;
+}();
+
+static std::size_t decode_scalar(const char *&in, const char *end, unsigned char *out, std::size_t capacity)
+{
+	std::size_t written = 0;
+	while (written + 3 <= capacity)
+	{
+		std::uint32_t group = 0;
+		int count = 0;
+		const char *p = in;
+		for (; p != end && count < 4; ++p)
+		{
+			const auto s = sextets[static_cast<unsigned char>(*p)];
+			if (s == 0x40)
+				continue;
+			if (s == 0x80)
+				break;
+			group = group << 6 | s;
+			++count;
+		}
+		if (count == 4)
+		{
+			out[written++] = static_cast<unsigned char>(group >> 16);
+			out[written++] = static_cast<unsigned char>(group >> 8);
+			out[written++] = static_cast<unsigned char>(group);
+			in = p;
+			continue;
+		}
+		// a final group shortened by padding or the end of the text, or
+		// only the whitespace before them
+		if (count >= 2)
+		{
+			group <<= 6 * (4 - count);
+			out[written++] = static_cast<unsigned char>(group >> 16);
+			if (count == 3)
+				out[written++] = static_cast<unsigned char>(group >> 8);
+		}
+		if (count != 1)
+			in = p;
+		break;
+	}
+	return written;
+}
+
+#ifdef EXTRACT_X86
+// the vector decoders follow Muła and Lemire, "Faster Base64 Encoding and
+// Decoding using AVX2 Instructions": nibble lookups validate and translate
+// each character, then multiply-adds pack four sextets into three bytes.
+// they stop at the first block holding anything but the alphabet and leave
+// it to the scalar decoder
+
+__attribute__((target("ssse3"))) static std::size_t decode_ssse3(const char *&in, const char *end, unsigned char *out, std::size_t capacity)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	std::size_t written = 0;
+	// 16 bytes are stored for every 12 decoded
+	for (; end - in >= 16 && written + 16 <= capacity; in += 16, written += 12)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+		const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2f);
+		const __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(v, mask_2f));
+		const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF)
+			break;
+		const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(v, mask_2f), hi_nibbles));
+		v = _mm_add_epi8(v, roll);
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + written), _mm_shuffle_epi8(v, pack));
+	}
+	return written;
+}
+
+__attribute__((target("avx2"))) static std::size_t decode_avx2(const char *&in, const char *end, unsigned char *out, std::size_t capacity)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+	std::size_t written = 0;
+	// 32 bytes are stored for every 24 decoded
+	for (; end - in >= 32 && written + 32 <= capacity; in += 32, written += 24)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+		const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+		const __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, mask_2f));
+		const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		if (!_mm256_testz_si256(lo, hi))
+			break;
+		const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(v, mask_2f), hi_nibbles));
+		v = _mm256_add_epi8(v, roll);
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), lanes);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + written), v);
+	}
+	return written;
+}
+
+#endif
+
+using decoder = std::size_t (*)(const char *&, const char *, unsigned char *, std::size_t);
+
+// the vector decoder for k, or nullptr for the scalar one alone
+static decoder vector_decoder(extract::kernel k)
+{
+#ifdef EXTRACT_X86
+	if (k == extract::kernel::avx2)
+		return decode_avx2;
+	if (k == extract::kernel::ssse3)
+		return decode_ssse3;
+#endif
+	return nullptr;
+}
+
+bool extract::supported(kernel k)
+{
+#ifdef EXTRACT_X86
+	__builtin_cpu_init();
+	if (k == kernel::avx2)
+		return __builtin_cpu_supports("avx2");
+	if (k == kernel::ssse3)
+		return __builtin_cpu_supports("ssse3");
+#endif
+	return k == kernel::scalar;
+}
+
+static const extract::kernel best = []
+{
+	for (const auto k : {extract::kernel::avx2, extract::kernel::ssse3})
+		if (extract::supported(k))
+			return k;
+	return extract::kernel::scalar;
+}();
+
+std::size_t extract::base64(std::string_view &in, char *out, std::size_t capacity)
+{
+	return base64(in, out, capacity, best);
+}
+
+std::size_t extract::base64(std::string_view &in, char *out, std::size_t capacity, kernel k)
+{
+	const auto vector_decode = vector_decoder(k);
+	const char *p = in.data();
+	const char *const end = p + in.size();
+	auto *o = reinterpret_cast<unsigned char *>(out);
+	std::size_t written = 0;
+	for (;;)
+	{
+		if (vector_decode)
+			written += vector_decode(p, end, o + written, capacity - written);
+		// a few groups of the scalar decoder get past whitespace, then the
+		// vector one carries on, until neither makes progress
+		const char *before = p;
+		const auto n = decode_scalar(p, end, o + written, std::min<std::size_t>(capacity - written, 48));
+		written += n;
+		if (p == before || p == end)
+			break;
+	}
+	in.remove_prefix(p - in.data());
+	return written;
+}
+
+// whether an item-id can name a file inside the extraction directory: nothing
+// that leads out of it, nor that needs quoting in the script naming the file
+static bool plain_name(std::string_view id)
+{
+	return !id.empty() && id.find_first_of("/\\:'") == std::string_view::npos && id.find("..") == std::string_view::npos &&
+		   std::none_of(id.begin(), id.end(), [](char c) { return static_cast<unsigned char>(c) < 0x20; });
+}
+
+template <typename Node>
+static std::string item_file_name(const Node &item)
+{
+	const std::string_view id = item.attribute("item-id").value();
+	if (!plain_name(id))
+		return {};
+	std::string_view text = item.text().get();
+	char head[12];
+	const auto n = extract::base64(text, head, sizeof(head));
+	const std::string_view magic(head, n);
+	const char *extension = ".bin";
+	if (magic.starts_with("\x89PNG"))
+		extension = ".png";
+	else if (magic.starts_with("\xFF\xD8\xFF"))
+		extension = ".jpg";
+	else if (magic.starts_with("GIF8"))
+		extension = ".gif";
+	else if (magic.starts_with("BM"))
+		extension = ".bmp";
+	else if (magic.starts_with("\x1F\x8B"))
+		extension = ".gz";
+	return std::string(id) + extension;
+}
+
+template <typename Node>
+static Node find(const Node &doc, std::string_view id)
+{
+	for (auto item = doc.child("worksheet").child("binaryContent").child("item"); item; item = item.next_sibling("item"))
+		if (id == item.attribute("item-id").value())
+			return item;
+	return {};
+}
+
+std::string extract::file_name(const pugi::xml_node &item)
+{
+	return item_file_name(item);
+}
+
+std::string extract::file_name(const snapshot::node &item)
+{
+	return item_file_name(item);
+}
+
+pugi::xml_node extract::find_item(const pugi::xml_node &doc, std::string_view id)
+{
+	return find(doc, id);
+}
+
+snapshot::node extract::find_item(const snapshot::node &doc, std::string_view id)
+{
+	return find(doc, id);
+}
+
+// streams one item's decoded bytes to path, so no decoded blob is held whole
+static bool write_item(std::string_view text, const fs::path &path, char *buffer)
+{
+	std::ofstream out(path, std::ios::binary);
+	while (out)
+	{
+		const auto n = extract::base64(text, buffer, chunk);
+		if (n == 0)
+			break;
+		out.write(buffer, n);
+	}
+	// only padding and whitespace may be left over
+	const bool complete = text.find_first_not_of("= \t\r\n") == std::string_view::npos;
+	return complete && out.flush();
+}
+
+bool extract::items(const pugi::xml_node &doc, const fs::path &dir)
+{
+	const auto content = doc.child("worksheet").child("binaryContent");
+	if (!content.child("item"))
+		return true;
+	std::error_code error;
+	fs::create_directories(dir, error);
+	const auto buffer = std::make_unique<char[]>(chunk);
+	bool ok = true;
+	for (auto item = content.child("item"); item; item = item.next_sibling("item"))
+	{
+		const auto name = file_name(item);
+		trace::span span("extract item", name);
+		if (name.empty() || !write_item(item.text().get(), dir / name, buffer.get()))
+			ok = false;
+	}
+	return ok;
+}
+
+extract::background::background()
+	: thread(&background::run, this)
+{
+}
+
+extract::background::~background()
+{
+	{
+		std::lock_guard lock(mutex);
+		done = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+void extract::background::start(const pugi::xml_node &d, fs::path to)
+{
+	std::lock_guard lock(mutex);
+	doc = d;
+	dir = std::move(to);
+	busy = true;
+	changed.notify_all();
+}
+
+bool extract::background::wait()
+{
+	std::unique_lock lock(mutex);
+	changed.wait(lock, [this] { return !busy; });
+	return ok;
+}
+
+void extract::background::run()
+{
+	trace::name_thread("extract");
+	std::unique_lock lock(mutex);
+	for (;;)
+	{
+		changed.wait(lock, [this] { return done || busy; });
+		if (!busy)
+			return;
+		const auto d = doc;
+		const auto to = dir;
+		lock.unlock();
+		const auto detail = to.string();
+		trace::span span("extract", detail);
+		const bool result = items(d, to);
+		lock.lock();
+		ok = result;
+		busy = false;
+		changed.notify_all();
+	}
+}
@@ -1,32 +1,145 @@
 #include <iostream>
-#include <unordered_map>
 #include <string_view>
-#include "converter_func.hpp"
 #include "matlab.hpp"
+#include "check.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "watch.hpp"
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+// evaluates every file natively and compares against the stored results
+static int check_files(int count, char* files[])
+{
+	int status = 0;
+	std::size_t checked = 0, mismatched = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		pugi::xml_document doc;
+		auto result = doc.load_file(files[i]);
+		if (!result)
+		{
+			std::cout << files[i] << ": error: " << result.description() << '\n';
+			status = 2;
+			continue;
+		}
+		auto report = check::worksheet(doc);
+		checked += report.checked;
+		mismatched += report.mismatches.size();
+		for (auto& m : report.mismatches)
+			std::cout << files[i] << ": region " << m.region << ": expected " << m.expected << ", got " << m.actual << '\n';
+	}
+	std::cout << "checked " << checked << " results in " << count << " files, " << mismatched << " mismatches\n";
+	if (status == 0 && mismatched)
+		status = 3;
+	return status;
+}
+
+// writes each file as a snapshot beside it, for faster conversions later
+static int snapshot_files(int count, char* files[])
+{
+	int status = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		pugi::xml_document doc;
+		auto result = doc.load_file(files[i]);
+		if (!result)
+		{
+			std::cout << files[i] << ": error: " << result.description() << '\n';
+			status = 2;
+			continue;
+		}
+		const auto path = std::filesystem::path(files[i]).replace_extension(snapshot::extension).string();
+		if (!snapshot::write(doc, path, matlab::skipped))
+		{
+			std::cout << path << ": error: could not write\n";
+			status = 2;
+		}
+	}
+	return status;
+}
+
+static int usage(std::string_view name)
+{
+	std::cout << "usage: " << name << " [<options>] <file name>\n";
+	std::cout << "       " << name << " [<options>] [--jobs=<n>] <file name>...\n";
+	std::cout << "       " << name << " [<options>] [--jobs=<n>] --watch <directory>\n";
+	std::cout << "       " << name << " --check <file name>...\n";
+	std::cout << "       " << name << " --snapshot <file name>...\n";
+	std::cout << "options: --cse[=<threshold>] --trace=<json file> --cache=<directory> --cache-size=<MB> --extract\n";
+	return 1;
+}
 
 int main(int argc, char* argv[])
 {
 	if (argc <= 1)
+		return usage(argv[0]);
+	if (std::string_view(argv[1]) == "--check")
+		return check_files(argc - 2, argv + 2);
+	if (std::string_view(argv[1]) == "--snapshot")
+		return snapshot_files(argc - 2, argv + 2);
+
+	matlab::options options;
+	unsigned jobs = std::thread::hardware_concurrency();
+	std::string_view watch_dir;
+	std::string_view cache_dir;
+	std::uintmax_t cache_size = 1024;
+	bool extract = false;
+	int arg = 1;
+	for (; arg < argc && std::string_view(argv[arg]).starts_with("--"); ++arg)
 	{
-		std::cout << "usage: " << std::string_view(argv[0]) << " <file name>\n";
-		return 1;
+		const std::string_view flag = argv[arg];
+		if (flag == "--cse")
+			options.cse_threshold = 8;
+		else if (flag.starts_with("--cse="))
+			options.cse_threshold = std::strtoul(argv[arg] + 6, nullptr, 10);
+		else if (flag.starts_with("--trace="))
+			trace::enable(argv[arg] + 8);
+		else if (flag.starts_with("--jobs="))
+			jobs = std::strtoul(argv[arg] + 7, nullptr, 10);
+		else if (flag.starts_with("--cache="))
+			cache_dir = argv[arg] + 8;
+		else if (flag.starts_with("--cache-size="))
+			cache_size = std::strtoull(argv[arg] + 13, nullptr, 10);
+		else if (flag == "--extract")
+			extract = true;
+		else if (flag == "--watch" && arg + 1 < argc)
+			watch_dir = argv[++arg];
+		else
+			return usage(argv[0]);
 	}
+	if ((arg == argc) == watch_dir.empty())
+		return usage(argv[0]);
 
-    std::unordered_map<std::string_view, converter_func> converters;
-	converters["matlab"] = matlab::convert;
-
+	std::unique_ptr<cache::directory> cache;
+	if (!cache_dir.empty())
+	{
+		// anything besides the input that changes the output must be part of the key
+		const auto settings = "matlab " + std::to_string(matlab::version) + " cse=" + std::to_string(options.cse_threshold) + (extract ? " extract" : "");
+		cache = std::make_unique<cache::directory>(cache_dir, cache_size << 20, settings);
+	}
+	if (!watch_dir.empty())
+		return watch::run(std::string(watch_dir), options, jobs, cache.get(), extract);
+	// several files are each converted to a .m file beside them
+	if (argc - arg > 1)
+		return batch::run({argv + arg, argv + argc}, options, jobs, cache.get(), extract);
+	trace::name_thread("main");
+	matlab::context ctx(options);
 
-	pugi::xml_document doc;
-	auto result = doc.load_file(argv[1]);
+	auto result = batch::convert_file(argv[arg], std::cout, ctx, cache.get(), extract);
 	if (!result)
 	{
 		std::cout << "error: " << result.description() << '\n';
 		return 2;
 	}
-	
-	auto convert = converters.at("matlab");
-	convert(doc, std::cout);
-	auto ids = matlab::get_undefined_ids();
-	for (auto& id : ids)
-		std::cout << id << " = ?\n";
+	{
+		trace::span span("flush");
+		std::cout.flush();
+	}
+	// only when this run converted rather than took the script from the cache
+	if (const auto stats = ctx.get_cse_stats(); stats && options.cse_threshold)
+		std::cerr << stats->temporaries << " temporaries, " << stats->deduplicated << " nodes deduplicated\n";
 }
@@ -0,0 +1,148 @@
+#include "mathcadconvert.h"
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "matlab.hpp"
+
+struct mcc_context
+{
+	matlab::context conversion;
+	std::string script;
+	std::vector<std::string> undefined_ids;
+	std::string error;
+};
+
+// no exception may cross into C
+template <typename F>
+static mcc_status guarded(mcc_context *ctx, F &&f)
+{
+	try
+	{
+		ctx->error.clear();
+		return f();
+	}
+	catch (const std::bad_alloc &)
+	{
+		ctx->error = "out of memory";
+		return MCC_OUT_OF_MEMORY;
+	}
+	catch (const std::exception &e)
+	{
+		ctx->error = e.what();
+		return MCC_INTERNAL_ERROR;
+	}
+	catch (...)
+	{
+		ctx->error = "unknown error";
+		return MCC_INTERNAL_ERROR;
+	}
+}
+
+static mcc_status copy(const std::string &script, char *buffer, std::size_t capacity, std::size_t *script_size)
+{
+	*script_size = script.size();
+	if (capacity < script.size())
+		return MCC_BUFFER_TOO_SMALL;
+	std::memcpy(buffer, script.data(), script.size());
+	return MCC_OK;
+}
+
+mcc_context *mcc_create(void)
+{
+	return new (std::nothrow) mcc_context;
+}
+
+void mcc_destroy(mcc_context *ctx)
+{
+	delete ctx;
+}
+
+mcc_status mcc_set_cse_threshold(mcc_context *ctx, size_t threshold)
+{
+	if (!ctx)
+		return MCC_INVALID_ARGUMENT;
+	ctx->conversion.opts.cse_threshold = threshold;
+	return MCC_OK;
+}
+
+mcc_status mcc_set_binary_dir(mcc_context *ctx, const char *dir)
+{
+	if (!ctx)
+		return MCC_INVALID_ARGUMENT;
+	return guarded(ctx, [&]
+	{
+		ctx->conversion.binary_dir = dir ? dir : "";
+		return MCC_OK;
+	});
+}
+
+mcc_status mcc_convert(mcc_context *ctx, const char *xml, size_t size, const char **script, size_t *script_size)
+{
+	if (!ctx || (!xml && size) || !script || !script_size)
+		return MCC_INVALID_ARGUMENT;
+	return guarded(ctx, [&]
+	{
+		ctx->script.clear();
+		ctx->undefined_ids.clear();
+		pugi::xml_document doc;
+		const auto result = doc.load_buffer(xml, size);
+		if (!result)
+		{
+			ctx->error = result.description();
+			return MCC_PARSE_ERROR;
+		}
+		std::ostringstream os;
+		ctx->conversion.convert(doc, os);
+		ctx->script = std::move(os).str();
+		ctx->undefined_ids.assign(ctx->conversion.undefined_ids.begin(), ctx->conversion.undefined_ids.end());
+		*script = ctx->script.c_str();
+		*script_size = ctx->script.size();
+		return MCC_OK;
+	});
+}
+
+mcc_status mcc_convert_into(mcc_context *ctx, const char *xml, size_t size, char *buffer, size_t capacity, size_t *script_size)
+{
+	if (!buffer && capacity)
+		return MCC_INVALID_ARGUMENT;
+	const char *script;
+	const auto status = mcc_convert(ctx, xml, size, &script, script_size);
+	if (status != MCC_OK)
+		return status;
+	return copy(ctx->script, buffer, capacity, script_size);
+}
+
+mcc_status mcc_copy_script(const mcc_context *ctx, char *buffer, size_t capacity, size_t *script_size)
+{
+	if (!ctx || (!buffer && capacity) || !script_size)
+		return MCC_INVALID_ARGUMENT;
+	return copy(ctx->script, buffer, capacity, script_size);
+}
+
+size_t mcc_undefined_id_count(const mcc_context *ctx)
+{
+	return ctx ? ctx->undefined_ids.size() : 0;
+}
+
+const char *mcc_undefined_id(const mcc_context *ctx, size_t index)
+{
+	if (!ctx || index >= ctx->undefined_ids.size())
+		return nullptr;
+	return ctx->undefined_ids[index].c_str();
+}
+
+void mcc_cse_stats(const mcc_context *ctx, size_t *temporaries, size_t *deduplicated)
+{
+	const auto stats = ctx ? ctx->conversion.get_cse_stats().value_or(matlab::cse_stats{}) : matlab::cse_stats{};
+	if (temporaries)
+		*temporaries = stats.temporaries;
+	if (deduplicated)
+		*deduplicated = stats.deduplicated;
+}
+
+const char *mcc_last_error(const mcc_context *ctx)
+{
+	return ctx ? ctx->error.c_str() : "no context";
+}
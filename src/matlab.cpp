@@ -2,16 +2,38 @@
 #include <unordered_map>
 #include <string_view>
 #include "converter_func.hpp"
+#include "cse.hpp"
+#include "extract.hpp"
+#include "trace.hpp"
 #include <stdlib.h>
 
 using sv = std::string_view;
-std::set<std::string> defined_id;
-std::set<std::string> undefined_id;
+// the context of a conversion travels with its stream, so converters keep the
+// converter_func signature
+static const int context_slot = std::ios_base::xalloc();
 
-static void skip(const pugi::xml_node &node, std::ostream &os)
+static matlab::context &state(std::ostream &os)
 {
+	return *static_cast<matlab::context *>(os.pword(context_slot));
 }
-static void traverse(const pugi::xml_node &node, std::ostream &os)
+// the part of the context for the kind of tree node belongs to
+template <typename Context>
+static auto &tree(Context &ctx, const pugi::xml_node &)
+{
+	return ctx.xml_tree;
+}
+template <typename Context>
+static auto &tree(Context &ctx, const snapshot::node &)
+{
+	return ctx.snapshot_tree;
+}
+
+template <typename Node>
+static void skip(const Node &node, std::ostream &os)
+{
+}
+template <typename Node>
+static void traverse(const Node &node, std::ostream &os)
 {
 	auto child = node.first_child();
 	while (child)
@@ -20,7 +42,34 @@ static void traverse(const pugi::xml_node &node, std::ostream &os)
 		child = child.next_sibling();
 	}
 }
-static void multi(const pugi::xml_node &node, std::ostream &os, sv between)
+template <typename Node>
+static void document(const Node &node, std::ostream &os)
+{
+	auto &ctx = state(os);
+	ctx.defined_ids.clear();
+	ctx.undefined_ids.clear();
+	auto &plan = tree(ctx, node).plan;
+	plan = ctx.opts.cse_threshold ? cse::analyze(node, ctx.opts.cse_threshold) : cse::basic_plan<Node>{};
+	ctx.stats = matlab::cse_stats{plan.temporaries, plan.deduplicated};
+	traverse(node, os);
+}
+template <typename Node>
+static void region(const Node &node, std::ostream &os)
+{
+	trace::span span("convert region", node.attribute("region-id").value());
+	traverse(node, os);
+}
+template <typename Node>
+static const std::string *temporary(const Node &node, const matlab::context &ctx)
+{
+	const auto &t = tree(ctx, node);
+	if (node == t.defining)
+		return nullptr;
+	auto temp = t.plan.replaced.find(node.internal_object());
+	return temp == t.plan.replaced.end() ? nullptr : &temp->second;
+}
+template <typename Node>
+static void multi(const Node &node, std::ostream &os, sv between)
 {
 	auto child = node.first_child();
 	while (child)
@@ -31,7 +80,8 @@ static void multi(const pugi::xml_node &node, std::ostream &os, sv between)
 			os << between;
 	}
 }
-static void function_args(pugi::xml_node args, std::ostream &os)
+template <typename Node>
+static void function_args(Node args, std::ostream &os)
 {
 	os << '(';
 	while (args)
@@ -43,24 +93,106 @@ static void function_args(pugi::xml_node args, std::ostream &os)
 	}
 	os << ')';
 }
-static void multimul(const pugi::xml_node &node, std::ostream &os)
+// MATLAB operator precedence, loosest binding first. Every MATLAB binary
+// operator (including ^) is left-associative, so a left operand may share the
+// operator's precedence but a right operand must bind strictly tighter.
+enum precedence : int
+{
+	prec_comparison,
+	prec_colon,
+	prec_additive,
+	prec_multiplicative,
+	prec_unary,
+	prec_power,
+	prec_primary,
+};
+struct binary_op
+{
+	sv op;
+	precedence prec;
+	sv sp = " ";
+};
+static const std::unordered_map<sv, binary_op> binary_ops = {
+		{"ml:plus", {"+", prec_additive}},
+		{"ml:minus", {"-", prec_additive}},
+		{"ml:mult", {"*", prec_multiplicative}},
+		{"ml:div", {"/", prec_multiplicative}},
+		{"ml:pow", {"^", prec_power, ""}},
+		{"ml:equal", {"==", prec_comparison}},
+		{"ml:greaterThan", {">", prec_comparison}},
+		{"ml:lessThan", {"<", prec_comparison}},
+};
+template <typename Node>
+static precedence precedence_of(const Node &node, const matlab::context &ctx)
+{
+	const auto name = sv(node.name());
+	if (name == "ml:apply" && !temporary(node, ctx))
+	{
+		const auto f = node.first_child();
+		const auto a = f.next_sibling();
+		if (!a)
+			return prec_primary;
+		const auto b = a.next_sibling();
+		if (!b && sv(f.name()) == "ml:neg")
+			return prec_unary;
+		if (b && !b.next_sibling())
+			if (auto op = binary_ops.find(f.name()); op != binary_ops.end())
+				return op->second.prec;
+		return prec_primary;
+	}
+	if (name == "ml:real")
+		return node.text().get()[0] == '-' ? prec_unary : prec_primary;
+	if (name == "unitedValue" || name == "unitMonomial")
+	{
+		const auto child = node.first_child();
+		return child.next_sibling() ? prec_multiplicative : precedence_of(child, ctx);
+	}
+	if (name == "unitReference" && node.attribute("power-numerator"))
+		return prec_power;
+	return prec_primary;
+}
+// converts node, adding parentheses only if it binds looser than min
+template <typename Node>
+static void operand(const Node &node, precedence min, std::ostream &os)
+{
+	if (precedence_of(node, state(os)) >= min)
+		return matlab::convert(node, os);
+	os << '(';
+	matlab::convert(node, os);
+	os << ')';
+}
+template <typename Node>
+static void multimul(const Node &node, std::ostream &os)
 {
-	multi(node, os, " * ");
+	auto child = node.first_child();
+	auto min = prec_multiplicative;
+	while (child)
+	{
+		operand(child, min, os);
+		min = precedence(prec_multiplicative + 1);
+		child = child.next_sibling();
+		if (child)
+			os << " * ";
+	}
 }
-static void sequence(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void sequence(const Node &node, std::ostream &os)
 {
 	multi(node, os, ", ");
 }
-static void unitOverride(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void unitOverride(const Node &node, std::ostream &os)
 {
     os << "; % ";
     traverse(node,os);
 }
-static void echo(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void echo(const Node &node, std::ostream &os)
 {
 	os << node.text().get();
 }
-static std::string id_string(const pugi::xml_node &node)
+template <typename Node>
+static std::string subscripted_id(const Node &node)
 {
 	std::string id(node.text().get());
 	const auto subscript = node.attribute("subscript");
@@ -71,17 +203,28 @@ static std::string id_string(const pugi::xml_node &node)
 	}
 	return id;
 }
-static void id(const pugi::xml_node &node, std::ostream &os)
+std::string matlab::id_string(const pugi::xml_node &node)
+{
+	return subscripted_id(node);
+}
+std::string matlab::id_string(const snapshot::node &node)
 {
-	std::string name = id_string(node);
+	return subscripted_id(node);
+}
+template <typename Node>
+static void id(const Node &node, std::ostream &os)
+{
+	std::string name = matlab::id_string(node);
 
-	auto it = std::find(defined_id.begin(), defined_id.end(), name);
-    if (it == defined_id.end())
-		undefined_id.insert(name);
+	auto &ctx = state(os);
+	auto it = std::find(ctx.defined_ids.begin(), ctx.defined_ids.end(), name);
+    if (it == ctx.defined_ids.end())
+		ctx.undefined_ids.insert(name);
 
 	os << name;
 }
-static void unitReference(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void unitReference(const Node &node, std::ostream &os)
 {
 	const auto unit = node.attribute("unit");
 	if (unit)
@@ -90,32 +233,83 @@ static void unitReference(const pugi::xml_node &node, std::ostream &os)
 	if (pow_num)
 		os << "^" << pow_num.value();
 }
-static void parens(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void parens(const Node &node, std::ostream &os)
 {
 	os << '(';
 	matlab::convert(node.first_child(), os);
 	os << ')';
 }
-static void apply_op(const pugi::xml_node &a, sv op, const pugi::xml_node &b, std::ostream &os, const sv sp = " ")
+
+// a negated primary, which MATLAB accepts unparenthesized as an exponent (a^-b)
+template <typename Node>
+static bool signed_primary(const Node &node, const matlab::context &ctx)
 {
-	os << '(';
-	matlab::convert(a, os);
-	os << sp << op << sp;
-	matlab::convert(b, os);
-	os << ')';
+	if (sv(node.name()) == "ml:real")
+		return node.text().get()[0] == '-';
+	if (sv(node.name()) != "ml:apply" || sv(node.first_child().name()) != "ml:neg")
+		return false;
+	const auto a = node.first_child().next_sibling();
+	return !a.next_sibling() && precedence_of(a, ctx) == prec_primary;
 }
-static void apply_function(const sv name, const pugi::xml_node& args, std::ostream &os)
+// whether node prints as a power ending in an unparenthesized ^-x; MATLAB
+// groups ^- from the right, so a^-b^c would mean a^(-(b^c))
+template <typename Node>
+static bool signed_power(const Node &node, const matlab::context &ctx)
+{
+	const auto name = sv(node.name());
+	if (name == "ml:apply" && !temporary(node, ctx))
+	{
+		const auto f = node.first_child();
+		const auto a = f.next_sibling();
+		const auto b = a.next_sibling();
+		return sv(f.name()) == "ml:pow" && b && !b.next_sibling() && signed_primary(b, ctx);
+	}
+	if (name == "unitedValue" || name == "unitMonomial")
+	{
+		const auto child = node.first_child();
+		return !child.next_sibling() && signed_power(child, ctx);
+	}
+	if (name == "unitReference")
+		return node.attribute("power-numerator").value()[0] == '-';
+	return false;
+}
+template <typename Node>
+static void apply_op(const Node &a, const binary_op &op, const Node &b, std::ostream &os)
+{
+	if (op.prec == prec_power && signed_power(a, state(os)))
+	{
+		os << '(';
+		matlab::convert(a, os);
+		os << ')';
+	}
+	else
+		operand(a, op.prec, os);
+	os << op.sp << op.op << op.sp;
+	if (op.prec == prec_power && signed_primary(b, state(os)))
+		return matlab::convert(b, os);
+	operand(b, precedence(op.prec + 1), os);
+}
+template <typename Node>
+static void apply_function(const sv name, const Node &args, std::ostream &os)
 {
 	os << name;
   function_args(args, os);
 }
-static void apply_function(const pugi::xml_node fun, std::ostream &os)
+template <typename Node>
+static void apply_function(const Node fun, std::ostream &os)
 {
 	matlab::convert(fun, os);
   function_args(fun.next_sibling(), os);
 }
-static void apply(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void apply(const Node &node, std::ostream &os)
 {
+	if (auto temp = temporary(node, state(os)))
+	{
+		os << *temp;
+		return;
+	}
 	const auto f = node.first_child();
 	const auto fname = sv(f.name());
 	if (fname == "ml:id")
@@ -136,10 +330,8 @@ static void apply(const pugi::xml_node &node, std::ostream &os)
 	{
 		if (fname == "ml:neg")
 		{
-			os << "(-";
-			matlab::convert(a, os);
-			os << ')';
-			return;
+			os << '-';
+			return operand(a, prec_unary, os);
 		}
 		if (fname == "ml:sqrt")
             return apply_function("sqrt",a,os);
@@ -154,22 +346,8 @@ static void apply(const pugi::xml_node &node, std::ostream &os)
 	const auto c = b.next_sibling();
 	if (c.type() == pugi::xml_node_type::node_null)
 	{
-		if (fname == "ml:plus")
-			return apply_op(a, "+", b, os);
-		if (fname == "ml:minus")
-			return apply_op(a, "-", b, os);
-		if (fname == "ml:mult")
-			return apply_op(a, "*", b, os);
-		if (fname == "ml:div")
-			return apply_op(a, "/", b, os);
-		if (fname == "ml:pow")
-			return apply_op(a, "^", b, os, "");
-		if (fname == "ml:equal")
-			return apply_op(a, "==", b, os);
-		if (fname == "ml:greaterThan")
-			return apply_op(a, ">", b, os);
-		if (fname == "ml:lessThan")
-			return apply_op(a, "<", b, os);
+		if (auto op = binary_ops.find(fname); op != binary_ops.end())
+			return apply_op(a, op->second, b, os);
         if (fname == "ml:indexer")
             return apply_function(a, os);
 
@@ -179,14 +357,15 @@ static void apply(const pugi::xml_node &node, std::ostream &os)
 	os << "'apply' contains <" << fname << "> with three (or more) arguments <" << a.name() << ">, <" << b.name() << ">, <" << c.name() << ">\n";
 	return;
 }
-static void define(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void define(const Node &node, std::ostream &os)
 {
 	const auto lhs = node.first_child();
 	const auto fname = sv(lhs.name());
 	const auto rhs = lhs.next_sibling();
 	if (fname == "ml:id")
 	{
-		defined_id.insert(id_string(lhs));
+		state(os).defined_ids.insert(matlab::id_string(lhs));
 	}
 	matlab::convert(lhs, os);
 	if (fname != "ml:function")
@@ -195,112 +374,199 @@ static void define(const pugi::xml_node &node, std::ostream &os)
 	}
 	matlab::convert(rhs, os);
 }
-static void boundVars(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void boundVars(const Node &node, std::ostream &os)
 {
 	os << " = @(";
 	multi(node,os,", ");
 	os << ") ";
 }
-static void math(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void math(const Node &node, std::ostream &os)
 {
+	auto &t = tree(state(os), node);
+	if (auto temps = t.plan.before.find(node.internal_object()); temps != t.plan.before.end())
+		for (auto &temp : temps->second)
+		{
+			os << temp.name << " = ";
+			t.defining = temp.expr;
+			matlab::convert(temp.expr, os);
+			t.defining = {};
+			os << ";\n";
+		}
 	matlab::convert(node.first_child(), os);
 	os << ";\n";
 }
-static void range(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void range(const Node &node, std::ostream &os)
 {
 	const auto a = node.first_child();
     const auto b = a.next_sibling();
     os << "((";
-    matlab::convert(a,os);
+    operand(a, precedence(prec_colon + 1), os);
     os << ':';
-    matlab::convert(b,os);
+    operand(b, precedence(prec_colon + 1), os);
     os << ") + ARRAY_OFFSET)";
 }
-static void text(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void text(const Node &node, std::ostream &os)
 {
 	matlab::convert(node.first_child(), os);
 	os << "\n";
 }
-static void comment(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void comment(const Node &node, std::ostream &os)
 {
 	os << "% " << node.text().get();
 }
-static void result(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void result(const Node &node, std::ostream &os)
 {
 	os << "; \% expected result: ";
 	matlab::convert(node.first_child(), os);
 }
-static void imag(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void imag(const Node &node, std::ostream &os)
 {
 	const auto symbol = node.attribute("symbol");
 	os << node.text().get() << symbol.value();
 }
-static void plot(const pugi::xml_node &node, std::ostream &os)
-{
-    os << "\% a mathcad plot was here but there is no good way to know what was in it\n";
-}
-static const std::unordered_map<std::string_view, converter_func> node_funcs = {
-		{"document", traverse},
-		{"worksheet", traverse},
-		{"settings", traverse},
-		{"regions", traverse},
-		{"region", traverse},
-		{"calculation", traverse},
-		{"units", traverse},
-		{"pointReleaseData", skip},
-		{"metadata", skip},
-		{"presentation", skip},
-		{"calculationBehavior", skip},
-		{"math", math},
-		{"editor", skip},
-		{"fileFormat", skip},
-		{"miscellaneous", skip},
-		{"textStyle", skip},
-		{"rendering", skip},
-		{"binaryContent", skip},
-		{"ml:provenance", traverse},
-		{"originRef", skip},
-		{"parentRef", skip},
-		{"comment", skip},
-		{"originComment", skip},
-		{"contentHash", skip},
-		{"text", text},
-		{"p", comment},
-		{"ml:apply", apply},
-		{"ml:parens", parens},
-		{"ml:real", echo},
-		{"ml:id", id},
-		{"ml:define", define},
-		{"ml:eval", traverse},
-		{"result", result},
-		{"unitReference", unitReference},
-		{"unitMonomial", multimul},
-		{"unitedValue", multimul},
-		{"ml:sequence", sequence},
-		{"ml:imag", imag},
-        {"plot", plot},
-        {"ml:range", range},
+template <typename Node>
+static void plot(const Node &node, std::ostream &os)
+{
+	const auto &binary_dir = state(os).binary_dir;
+	const auto item = binary_dir.empty() ? Node() : extract::find_item(node.root(), node.attribute("item-idref").value());
+	const auto name = item ? extract::file_name(item) : std::string();
+	if (name.empty())
+	{
+		os << "\% a mathcad plot was here but there is no good way to know what was in it\n";
+		return;
+	}
+	// MATLAB doubles quotes inside a quoted string
+	std::string file;
+	for (const char c : binary_dir + '/' + name)
+		file.append(c == '\'' ? 2 : 1, c);
+	if (file.ends_with(".png") || file.ends_with(".jpg") || file.ends_with(".gif") || file.ends_with(".bmp"))
+		os << "figure; imshow(imread('" << file << "')); \% a mathcad plot\n";
+	else
+		os << "\% a mathcad plot was here; its data was extracted to '" << file << "'\n";
+}
+template <typename Node>
+static const std::unordered_map<std::string_view, basic_converter_func<Node>> node_funcs = {
+		{"document", document<Node>},
+		{"worksheet", traverse<Node>},
+		{"settings", traverse<Node>},
+		{"regions", traverse<Node>},
+		{"region", region<Node>},
+		{"calculation", traverse<Node>},
+		{"units", traverse<Node>},
+		{"pointReleaseData", skip<Node>},
+		{"metadata", skip<Node>},
+		{"presentation", skip<Node>},
+		{"calculationBehavior", skip<Node>},
+		{"math", math<Node>},
+		{"editor", skip<Node>},
+		{"fileFormat", skip<Node>},
+		{"miscellaneous", skip<Node>},
+		{"textStyle", skip<Node>},
+		{"rendering", skip<Node>},
+		{"binaryContent", skip<Node>},
+		{"ml:provenance", traverse<Node>},
+		{"originRef", skip<Node>},
+		{"parentRef", skip<Node>},
+		{"comment", skip<Node>},
+		{"originComment", skip<Node>},
+		{"contentHash", skip<Node>},
+		{"text", text<Node>},
+		{"p", comment<Node>},
+		{"ml:apply", apply<Node>},
+		{"ml:parens", parens<Node>},
+		{"ml:real", echo<Node>},
+		{"ml:id", id<Node>},
+		{"ml:define", define<Node>},
+		{"ml:eval", traverse<Node>},
+		{"result", result<Node>},
+		{"unitReference", unitReference<Node>},
+		{"unitMonomial", multimul<Node>},
+		{"unitedValue", multimul<Node>},
+		{"ml:sequence", sequence<Node>},
+		{"ml:imag", imag<Node>},
+        {"plot", plot<Node>},
+        {"ml:range", range<Node>},
 		//{"unitedValue", traverse},
 		//{"unitMonomial", traverse},
 		//{"unitReference", extract_unit}, // closure would help
-		{"ml:unitOverride", unitOverride},
-		{"ml:function", traverse},
-		{"ml:boundVars", boundVars},
+		{"ml:unitOverride", unitOverride<Node>},
+		{"ml:function", traverse<Node>},
+		{"ml:boundVars", boundVars<Node>},
 };
 
-void matlab::convert(const pugi::xml_node &node, std::ostream &os)
+template <typename Node>
+static void dispatch(const Node &node, std::ostream &os)
 {
+	if (!os.pword(context_slot))
+	{
+		matlab::context ctx;
+		return ctx.convert(node, os);
+	}
+	const auto &funcs = node_funcs<Node>;
 	auto t = node.type();
 	if (t != pugi::xml_node_type::node_element && t != pugi::xml_node_type::node_document)
 		return;
 	const char *name = (t == pugi::xml_node_type::node_document) ? "document" : node.name();
-	if (auto func = node_funcs.find(name); func != node_funcs.end() && func->second)
+	if (auto func = funcs.find(name); func != funcs.end() && func->second)
 		func->second(node, os);
 	else
 		os << "'" << name << "' function not found\n";
 }
 
-std::set<std::string> matlab::get_undefined_ids()
+void matlab::convert(const pugi::xml_node &node, std::ostream &os)
+{
+	dispatch(node, os);
+}
+
+void matlab::convert(const snapshot::node &node, std::ostream &os)
+{
+	dispatch(node, os);
+}
+
+template <typename Node>
+static void attach(matlab::context &ctx, const Node &node, std::ostream &os)
+{
+	// restores whatever was attached before, even if converting throws
+	struct attachment
+	{
+		std::ostream &os;
+		void *previous;
+		~attachment() { os.pword(context_slot) = previous; }
+	} attached{os, os.pword(context_slot)};
+	os.pword(context_slot) = &ctx;
+	matlab::convert(node, os);
+}
+
+void matlab::context::convert(const pugi::xml_node &node, std::ostream &os)
 {
-	return undefined_id;
-}
\ No newline at end of file
+	attach(*this, node, os);
+}
+
+void matlab::context::convert(const snapshot::node &node, std::ostream &os)
+{
+	attach(*this, node, os);
+}
+
+std::optional<matlab::cse_stats> matlab::context::get_cse_stats() const
+{
+	return stats;
+}
+
+bool matlab::skipped(std::string_view element)
+{
+	// plots look their items up in binaryContent, wherever it is converted
+	if (element == "binaryContent")
+		return false;
+	const auto func = node_funcs<pugi::xml_node>.find(element);
+	if (func == node_funcs<pugi::xml_node>.end())
+		return false;
+	const auto target = func->second.target<void (*)(const pugi::xml_node &, std::ostream &)>();
+	return target && *target == skip<pugi::xml_node>;
+}
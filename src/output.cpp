@@ -0,0 +1,43 @@
+#include "output.hpp"
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+namespace fs = std::filesystem;
+
+static constexpr std::string_view suffix = ".tmp";
+
+bool output::replace(const fs::path &path, const std::function<bool(std::ostream &)> &write)
+{
+	thread_local std::mt19937_64 random(std::random_device{}());
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(random()));
+	auto temp = path;
+	temp += std::string(suffix) + name;
+	std::error_code ignored;
+	{
+		std::ofstream out(temp, std::ios::binary);
+		if (!out || !write(out) || !out.flush())
+		{
+			out.close();
+			fs::remove(temp, ignored);
+			return false;
+		}
+	}
+	std::error_code error;
+	fs::rename(temp, path, error);
+	if (!error)
+		return true;
+	fs::remove(temp, ignored);
+	return false;
+}
+
+bool output::replace(const fs::path &path, std::string_view contents)
+{
+	return replace(path, [contents](std::ostream &out) { return bool(out.write(contents.data(), contents.size())); });
+}
+
+bool output::temporary(const fs::path &path)
+{
+	return path.extension().string().starts_with(suffix);
+}
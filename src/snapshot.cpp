@@ -0,0 +1,310 @@
+#include "snapshot.hpp"
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "output.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SNAPSHOT_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using sv = std::string_view;
+
+static constexpr char magic[8] = {'M', 'C', 'D', 'S', 'N', 'A', 'P', '\0'};
+static constexpr std::uint32_t byte_order = 0x01020304;
+// base64 characters kept of each binaryContent item, without whitespace;
+// enough for extract::file_name
+static constexpr std::size_t item_head = 16;
+
+static std::uint64_t align8(std::uint64_t n)
+{
+	return (n + 7) & ~std::uint64_t(7);
+}
+
+namespace
+{
+	// tables with absolute positions while building; made relative on writing
+	struct builder
+	{
+		struct node
+		{
+			std::uint64_t name, value, attributes;
+			std::uint32_t parent = 0, first_child = 0, next_sibling = 0;
+			std::uint16_t type = 0, attribute_count = 0;
+		};
+		std::vector<node> nodes;
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> attributes;
+		std::string strings;
+		// worksheets repeat the same names and numbers over and over
+		std::unordered_map<sv, std::uint64_t> interned;
+		std::vector<std::unique_ptr<std::string>> keys;
+		const std::function<bool(sv)> *skip;
+		// set when the tree does not fit the format's limits
+		bool too_large = false;
+
+		std::uint64_t intern(sv s)
+		{
+			if (auto it = interned.find(s); it != interned.end())
+				return it->second;
+			const auto at = strings.size();
+			strings.append(s);
+			strings += '\0';
+			keys.push_back(std::make_unique<std::string>(s));
+			interned.emplace(*keys.back(), at);
+			return at;
+		}
+		// returns whether node was stored, and as which index
+		bool add(const pugi::xml_node &n, std::uint32_t parent, sv value, std::uint32_t &index)
+		{
+			const auto type = n.type();
+			if (type != pugi::node_document && type != pugi::node_element && type != pugi::node_pcdata && type != pugi::node_cdata)
+				return false;
+			if (nodes.size() >= std::numeric_limits<std::int32_t>::max())
+			{
+				too_large = true;
+				return false;
+			}
+			index = static_cast<std::uint32_t>(nodes.size());
+			node r{intern(n.name()), intern(value), attributes.size(), parent};
+			r.type = static_cast<std::uint16_t>(type);
+			std::size_t count = 0;
+			for (auto a = n.first_attribute(); a; a = a.next_attribute(), ++count)
+				attributes.emplace_back(intern(a.name()), intern(a.value()));
+			if (count > std::numeric_limits<std::uint16_t>::max())
+			{
+				too_large = true;
+				return false;
+			}
+			r.attribute_count = static_cast<std::uint16_t>(count);
+			nodes.push_back(r);
+			return true;
+		}
+		void tree(const pugi::xml_node &n, std::uint32_t parent)
+		{
+			std::uint32_t index;
+			if (!add(n, parent, n.value(), index))
+				return;
+			const bool items = sv(n.name()) == "binaryContent";
+			std::uint32_t last = 0;
+			for (auto child = n.first_child(); child; child = child.next_sibling())
+			{
+				const auto before = nodes.size();
+				if (items)
+					item(child, index);
+				else if (child.type() != pugi::node_element || !(*skip)(child.name()))
+					tree(child, index);
+				if (nodes.size() == before)
+					continue;
+				const auto added = static_cast<std::uint32_t>(before);
+				(last ? nodes[last].next_sibling : nodes[index].first_child) = added;
+				last = added;
+			}
+		}
+		void item(const pugi::xml_node &n, std::uint32_t parent)
+		{
+			std::uint32_t index, text;
+			if (sv(n.name()) != "item" || !add(n, parent, {}, index))
+				return;
+			// pugixml keeps the indentation and line breaks around the payload
+			std::string head;
+			for (const char *p = n.text().get(); *p && head.size() < item_head; ++p)
+				if (!std::isspace(static_cast<unsigned char>(*p)))
+					head += *p;
+			if (add(n.first_child(), index, head, text))
+				nodes[index].first_child = text;
+		}
+	};
+}
+
+bool snapshot::write(const pugi::xml_node &doc, const std::string &path, const std::function<bool(sv)> &skip)
+{
+	builder b;
+	b.skip = &skip;
+	b.intern("");
+	b.tree(doc.root(), 0);
+	if (b.nodes.empty() || b.too_large)
+		return false;
+
+	header h{};
+	std::memcpy(h.magic, magic, sizeof(magic));
+	h.version = version;
+	h.byte_order = byte_order;
+	h.nodes = align8(sizeof(header));
+	h.node_count = b.nodes.size();
+	h.attributes = h.nodes + h.node_count * sizeof(node_record);
+	h.attribute_count = b.attributes.size();
+	h.strings = h.attributes + h.attribute_count * sizeof(attribute_record);
+	h.string_bytes = b.strings.size();
+	h.size = align8(h.strings + h.string_bytes);
+
+	std::vector<node_record> nodes(b.nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		const auto &n = b.nodes[i];
+		const auto at = static_cast<std::int64_t>(h.nodes + i * sizeof(node_record));
+		const auto relative = [i](std::uint32_t to) { return to ? static_cast<std::int32_t>(std::int64_t(to) - std::int64_t(i)) : 0; };
+		nodes[i] = {
+			static_cast<std::int64_t>(h.strings + n.name) - at,
+			static_cast<std::int64_t>(h.strings + n.value) - at,
+			static_cast<std::int64_t>(h.attributes + n.attributes * sizeof(attribute_record)) - at,
+			i ? static_cast<std::int32_t>(std::int64_t(n.parent) - std::int64_t(i)) : 0,
+			relative(n.first_child),
+			relative(n.next_sibling),
+			n.type,
+			n.attribute_count,
+		};
+	}
+	std::vector<attribute_record> attributes(b.attributes.size());
+	for (std::size_t i = 0; i < attributes.size(); ++i)
+	{
+		const auto at = static_cast<std::int64_t>(h.attributes + i * sizeof(attribute_record));
+		attributes[i] = {static_cast<std::int64_t>(h.strings + b.attributes[i].first) - at, static_cast<std::int64_t>(h.strings + b.attributes[i].second) - at};
+	}
+
+	// readers only ever see a complete file
+	return output::replace(path, [&](std::ostream &out)
+	{
+		const char padding[8] = {};
+		out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+		out.write(padding, h.nodes - sizeof(h));
+		out.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(node_record));
+		out.write(reinterpret_cast<const char *>(attributes.data()), attributes.size() * sizeof(attribute_record));
+		out.write(b.strings.data(), b.strings.size());
+		out.write(padding, h.size - h.strings - h.string_bytes);
+		return bool(out);
+	});
+}
+
+snapshot::file::file(const std::string &path)
+{
+#ifdef SNAPSHOT_MMAP
+	const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		fail("cannot open file");
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(header)))
+	{
+		void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			data = static_cast<const char *>(p);
+			length = st.st_size;
+			mapped = true;
+		}
+	}
+	::close(fd);
+	if (!mapped)
+	{
+		fail("file too small or cannot be mapped");
+		return;
+	}
+#else
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in)
+	{
+		fail("cannot open file");
+		return;
+	}
+	const auto size = in.tellg();
+	if (size < 0)
+	{
+		fail("cannot read file");
+		return;
+	}
+	length = static_cast<std::size_t>(size);
+	owned = std::make_unique<std::uint64_t[]>(align8(length) / 8);
+	in.seekg(0);
+	if (length < sizeof(header) || !in.read(reinterpret_cast<char *>(owned.get()), length))
+	{
+		fail("file too small or cannot be read");
+		return;
+	}
+	data = reinterpret_cast<const char *>(owned.get());
+#endif
+
+	header h;
+	std::memcpy(&h, data, sizeof(h));
+	if (std::memcmp(h.magic, magic, sizeof(magic)) != 0)
+		fail("not a snapshot");
+	else if (h.byte_order != byte_order)
+		fail("snapshot written with another byte order");
+	else if (h.version != version)
+		fail("snapshot version " + std::to_string(h.version) + ", expected " + std::to_string(version));
+	else if (h.size != length)
+		fail("snapshot truncated");
+	// each table in order, aligned, within the file, and at least the document node
+	else if (h.nodes < sizeof(h) || h.nodes % 8 || h.nodes > length || h.node_count == 0 || h.node_count > (length - h.nodes) / sizeof(node_record) ||
+			 h.attributes != h.nodes + h.node_count * sizeof(node_record) || h.attribute_count > (length - h.attributes) / sizeof(attribute_record) ||
+			 h.strings != h.attributes + h.attribute_count * sizeof(attribute_record) || h.string_bytes == 0 || h.string_bytes > length - h.strings ||
+			 data[h.strings + h.string_bytes - 1] != '\0')
+		fail("snapshot tables out of bounds");
+}
+
+snapshot::file::~file()
+{
+#ifdef SNAPSHOT_MMAP
+	if (mapped)
+		munmap(const_cast<char *>(data), length);
+#endif
+}
+
+bool snapshot::file::fail(std::string why)
+{
+	message = std::move(why);
+	return false;
+}
+
+bool snapshot::file::verify()
+{
+	if (!*this)
+		return false;
+	header h;
+	std::memcpy(&h, data, sizeof(h));
+	const auto nodes = reinterpret_cast<const node_record *>(data + h.nodes);
+	const auto attributes = reinterpret_cast<const attribute_record *>(data + h.attributes);
+	// strings must start within the table; the header check made it end in a NUL
+	const auto string_ok = [&](const void *record, std::int64_t offset)
+	{
+		const auto at = static_cast<const char *>(record) - data + offset;
+		return at >= static_cast<std::int64_t>(h.strings) && at < static_cast<std::int64_t>(h.strings + h.string_bytes);
+	};
+	const auto node_ok = [&](std::uint64_t i, std::int32_t offset)
+	{
+		return offset == 0 || (static_cast<std::int64_t>(i) + offset >= 0 && static_cast<std::uint64_t>(i + offset) < h.node_count);
+	};
+	for (std::uint64_t i = 0; i < h.node_count; ++i)
+	{
+		const auto &n = nodes[i];
+		const auto first = (reinterpret_cast<const char *>(&n) - data + n.attributes - static_cast<std::int64_t>(h.attributes));
+		if (!string_ok(&n, n.name) || !string_ok(&n, n.value) ||
+			first < 0 || first % sizeof(attribute_record) || static_cast<std::uint64_t>(first) / sizeof(attribute_record) + n.attribute_count > h.attribute_count)
+			return fail("snapshot node " + std::to_string(i) + " out of bounds");
+		// children and siblings only ever lie ahead, so walks always end
+		if (!node_ok(i, n.parent) || n.parent > 0 || n.first_child < 0 || n.next_sibling < 0 || !node_ok(i, n.first_child) || !node_ok(i, n.next_sibling) || (i && !n.parent))
+			return fail("snapshot node " + std::to_string(i) + " has a broken link");
+		if (n.type != pugi::node_element && n.type != pugi::node_pcdata && n.type != pugi::node_cdata && !(i == 0 && n.type == pugi::node_document))
+			return fail("snapshot node " + std::to_string(i) + " has an unknown type");
+	}
+	for (std::uint64_t i = 0; i < h.attribute_count; ++i)
+		if (!string_ok(attributes + i, attributes[i].name) || !string_ok(attributes + i, attributes[i].value))
+			return fail("snapshot attribute " + std::to_string(i) + " out of bounds");
+	return true;
+}
+
+snapshot::node snapshot::file::document() const
+{
+	if (!*this)
+		return {};
+	header h;
+	std::memcpy(&h, data, sizeof(h));
+	return node(reinterpret_cast<const node_record *>(data + h.nodes));
+}
@@ -0,0 +1,156 @@
+#include "trace.hpp"
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct event
+	{
+		const char *name;
+		std::int64_t start;
+		std::int64_t duration;
+		char detail[48];
+	};
+	// only the owning thread writes; once full the oldest events are
+	// overwritten, so a long run keeps its most recent history
+	struct buffer
+	{
+		static constexpr std::size_t capacity = 1 << 14;
+		std::array<event, capacity> events;
+		std::atomic<std::uint64_t> head = 0;
+		std::size_t tid = 0;
+		std::string name;
+	};
+
+	std::atomic<bool> recording = false;
+	std::string output;
+	// buffers are registered once per thread and live until exit, so spans of
+	// finished workers are still written
+	std::mutex registry_mutex;
+	std::vector<std::unique_ptr<buffer>> registry;
+	const auto epoch = std::chrono::steady_clock::now();
+}
+
+static std::int64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+static buffer &local()
+{
+	thread_local buffer *b = []
+	{
+		auto owned = std::make_unique<buffer>();
+		std::lock_guard lock(registry_mutex);
+		owned->tid = registry.size() + 1;
+		registry.push_back(std::move(owned));
+		return registry.back().get();
+	}();
+	return *b;
+}
+// keeps the end of long details, which for paths is the file name
+static void copy_detail(char (&to)[sizeof(event::detail)], std::string_view detail)
+{
+	if (detail.size() >= sizeof(to))
+	{
+		detail = detail.substr(detail.size() - (sizeof(to) - 1));
+		while (!detail.empty() && (detail.front() & 0xC0) == 0x80)
+			detail.remove_prefix(1);
+	}
+	std::memcpy(to, detail.data(), detail.size());
+	to[detail.size()] = '\0';
+}
+static void escaped(std::FILE *f, std::string_view s)
+{
+	for (const char c : s)
+	{
+		if (c == '"' || c == '\\')
+			std::fprintf(f, "\\%c", c);
+		else if (static_cast<unsigned char>(c) < 0x20)
+			std::fprintf(f, "\\u%04x", c);
+		else
+			std::fputc(c, f);
+	}
+}
+static void write()
+{
+	recording = false;
+	std::FILE *f = std::fopen(output.c_str(), "w");
+	if (!f)
+	{
+		std::perror(output.c_str());
+		return;
+	}
+	std::lock_guard lock(registry_mutex);
+	std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	const char *separator = "";
+	for (const auto &b : registry)
+	{
+		if (!b->name.empty())
+		{
+			std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"", separator, b->tid);
+			escaped(f, b->name);
+			std::fputs("\"}}", f);
+			separator = ",\n";
+		}
+		const auto head = b->head.load(std::memory_order_acquire);
+		const auto first = head > buffer::capacity ? head - buffer::capacity : 0;
+		for (auto i = first; i < head; ++i)
+		{
+			const auto &e = b->events[i % buffer::capacity];
+			std::fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f", separator, e.name, b->tid, e.start / 1e3, e.duration / 1e3);
+			if (e.detail[0])
+			{
+				std::fputs(",\"args\":{\"detail\":\"", f);
+				escaped(f, e.detail);
+				std::fputs("\"}", f);
+			}
+			std::fputc('}', f);
+			separator = ",\n";
+		}
+	}
+	std::fputs("\n]}\n", f);
+	std::fclose(f);
+}
+
+void trace::enable(const std::string &path)
+{
+	output = path;
+	if (!recording.exchange(true))
+		std::atexit(write);
+}
+
+bool trace::enabled()
+{
+	return recording.load(std::memory_order_relaxed);
+}
+
+void trace::name_thread(std::string_view name)
+{
+	if (enabled())
+		local().name = name;
+}
+
+trace::span::span(const char *name, std::string_view detail)
+	: name(name), detail(detail), start(enabled() ? now() : -1)
+{
+}
+
+trace::span::~span()
+{
+	if (start < 0 || !enabled())
+		return;
+	auto &b = local();
+	const auto head = b.head.load(std::memory_order_relaxed);
+	auto &e = b.events[head % buffer::capacity];
+	e.name = name;
+	e.start = start;
+	e.duration = now() - start;
+	copy_detail(e.detail, detail);
+	b.head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,301 @@
+#include "watch.hpp"
+#include <iostream>
+
+#ifdef __linux__
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include "batch.hpp"
+#include "output.hpp"
+#include "trace.hpp"
+
+namespace fs = std::filesystem;
+using clock_type = std::chrono::steady_clock;
+
+// editors save in bursts (truncate, write, rename); a file is converted once
+// it has been quiet this long
+static constexpr auto debounce = std::chrono::milliseconds(200);
+static constexpr std::uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY | IN_DELETE_SELF;
+
+namespace
+{
+	struct change
+	{
+		clock_type::time_point first;
+		clock_type::time_point last;
+	};
+	struct job
+	{
+		std::string path;
+		clock_type::time_point changed;
+	};
+	struct stats
+	{
+		std::size_t converted = 0;
+		std::size_t failed = 0;
+		double total_latency = 0;
+		double max_latency = 0;
+	};
+	struct state
+	{
+		int fd;
+		std::unordered_map<int, fs::path> dirs;
+		std::unordered_map<std::string, change> pending;
+
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<job> queue;
+		// never converted twice at once; changes meanwhile stay pending
+		std::set<std::string> in_flight;
+		bool done = false;
+		stats totals;
+	};
+}
+
+static double milliseconds(clock_type::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+static bool is_worksheet(const fs::path &path)
+{
+	return path.extension() == ".xmcd";
+}
+static bool stale(const fs::path &path)
+{
+	std::error_code error;
+	const auto output = fs::last_write_time(batch::output_path(path.string()), error);
+	return error || output < fs::last_write_time(path, error);
+}
+static void add_change(state &s, const std::string &path, clock_type::time_point now)
+{
+	auto [it, inserted] = s.pending.try_emplace(path, change{now, now});
+	it->second.last = now;
+}
+// watches dir and everything below it, queueing worksheets that are out of date
+static void add_tree(state &s, const fs::path &dir, clock_type::time_point now)
+{
+	const auto add = [&s](const fs::path &d)
+	{
+		const int wd = inotify_add_watch(s.fd, d.c_str(), watch_mask);
+		if (wd < 0)
+			std::cerr << d.string() << ": warning: cannot watch\n";
+		else
+			s.dirs[wd] = d;
+	};
+	add(dir);
+	std::error_code error;
+	for (auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+	{
+		if (it->is_directory(error))
+			add(it->path());
+		else if (is_worksheet(it->path()) && stale(it->path()))
+			add_change(s, it->path().string(), now);
+	}
+}
+static void read_events(state &s)
+{
+	alignas(inotify_event) char buffer[64 * 1024];
+	const auto length = ::read(s.fd, buffer, sizeof(buffer));
+	const auto now = clock_type::now();
+	for (ssize_t offset = 0; offset < length;)
+	{
+		const auto &e = *reinterpret_cast<const inotify_event *>(buffer + offset);
+		offset += sizeof(inotify_event) + e.len;
+		if (e.mask & IN_Q_OVERFLOW)
+		{
+			// events were lost, so rescan everything for stale outputs
+			for (const auto &[wd, dir] : std::vector(s.dirs.begin(), s.dirs.end()))
+				add_tree(s, dir, now);
+			continue;
+		}
+		if (e.mask & IN_IGNORED)
+		{
+			s.dirs.erase(e.wd);
+			continue;
+		}
+		const auto dir = s.dirs.find(e.wd);
+		if (dir == s.dirs.end() || !e.len)
+			continue;
+		const auto path = dir->second / e.name;
+		if (e.mask & IN_ISDIR)
+		{
+			if (e.mask & (IN_CREATE | IN_MOVED_TO))
+				add_tree(s, path, now);
+		}
+		else if (is_worksheet(path))
+			add_change(s, path.string(), now);
+	}
+}
+// hands every change that has been quiet for the debounce period to the pool;
+// returns how long to wait for the next one
+static int dispatch(state &s)
+{
+	const auto now = clock_type::now();
+	auto wait = clock_type::duration::max();
+	std::lock_guard lock(s.mutex);
+	for (auto it = s.pending.begin(); it != s.pending.end();)
+	{
+		const auto quiet = now - it->second.last;
+		if (quiet < debounce || s.in_flight.contains(it->first))
+		{
+			wait = std::min(wait, quiet < debounce ? debounce - quiet : debounce);
+			++it;
+			continue;
+		}
+		s.in_flight.insert(it->first);
+		s.queue.push_back({it->first, it->second.first});
+		it = s.pending.erase(it);
+	}
+	s.ready.notify_all();
+	if (wait == clock_type::duration::max())
+		return -1;
+	return std::max<int>(1, std::chrono::ceil<std::chrono::milliseconds>(wait).count());
+}
+static void worker(state &s, unsigned n, const matlab::options &options, cache::directory *cache, bool extract)
+{
+	trace::name_thread("watch worker " + std::to_string(n));
+	matlab::context ctx(options);
+	for (;;)
+	{
+		job j;
+		{
+			std::unique_lock lock(s.mutex);
+			s.ready.wait(lock, [&s] { return s.done || !s.queue.empty(); });
+			if (s.queue.empty())
+				return;
+			j = std::move(s.queue.front());
+			s.queue.pop_front();
+		}
+
+		const auto start = clock_type::now();
+		std::ostringstream os;
+		const auto result = batch::convert_file(j.path, os, ctx, cache, extract);
+		bool ok = static_cast<bool>(result);
+		if (ok)
+		{
+			trace::span span("flush", j.path);
+			ok = output::replace(batch::output_path(j.path), os.view());
+		}
+		const auto end = clock_type::now();
+
+		std::lock_guard lock(s.mutex);
+		s.in_flight.erase(j.path);
+		if (!ok)
+		{
+			++s.totals.failed;
+			std::cerr << j.path << ": error: " << (result ? "could not write output" : result.description()) << '\n';
+			continue;
+		}
+		const auto latency = milliseconds(end - j.changed);
+		++s.totals.converted;
+		s.totals.total_latency += latency;
+		s.totals.max_latency = std::max(s.totals.max_latency, latency);
+		std::cerr << j.path << ": converted in " << milliseconds(end - start) << " ms, " << latency << " ms after change";
+		if (const auto stats = ctx.get_cse_stats(); stats && options.cse_threshold)
+			std::cerr << ", " << stats->temporaries << " temporaries, " << stats->deduplicated << " nodes deduplicated";
+		std::cerr << '\n';
+	}
+}
+
+int watch::run(const std::string &dir, const matlab::options &options, unsigned jobs, cache::directory *cache, bool extract)
+{
+	state s;
+	s.fd = inotify_init1(IN_CLOEXEC);
+	if (s.fd < 0)
+	{
+		std::cerr << "error: inotify unavailable\n";
+		return 2;
+	}
+	if (!fs::is_directory(dir))
+	{
+		std::cerr << dir << ": error: not a directory\n";
+		return 2;
+	}
+
+	// stop signals are read from a descriptor polled with inotify's; blocked
+	// before the workers start so that they inherit the mask and none of
+	// them takes the signal instead
+	sigset_t stop, previous;
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, &previous);
+	const int signals = signalfd(-1, &stop, SFD_CLOEXEC);
+	if (signals < 0)
+	{
+		pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+		close(s.fd);
+		std::cerr << "error: signalfd unavailable\n";
+		return 2;
+	}
+
+	const auto started = clock_type::now();
+	add_tree(s, dir, started);
+	// outputs that were already stale need no debouncing
+	for (auto &[path, c] : s.pending)
+		c.last = started - debounce;
+	std::cerr << "watching " << s.dirs.size() << " directories under " << dir << '\n';
+
+	std::vector<std::thread> threads;
+	for (unsigned n = 1; n <= std::clamp(jobs, 1u, 4u); ++n)
+		threads.emplace_back(worker, std::ref(s), n, std::cref(options), cache, extract);
+
+	pollfd p[] = {{s.fd, POLLIN, 0}, {signals, POLLIN, 0}};
+	for (;;)
+	{
+		const int timeout = dispatch(s);
+		if (poll(p, 2, timeout) <= 0)
+			continue;
+		if (p[1].revents & POLLIN)
+		{
+			signalfd_siginfo info;
+			[[maybe_unused]] const auto n = ::read(signals, &info, sizeof(info));
+			break;
+		}
+		if (p[0].revents & POLLIN)
+			read_events(s);
+	}
+
+	{
+		std::lock_guard lock(s.mutex);
+		s.done = true;
+		s.queue.clear();
+	}
+	s.ready.notify_all();
+	for (auto &t : threads)
+		t.join();
+	close(s.fd);
+	close(signals);
+	pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+	const auto elapsed = std::chrono::duration<double>(clock_type::now() - started).count();
+	const auto &t = s.totals;
+	std::cerr << t.converted << " converted, " << t.failed << " failed in " << elapsed << " s ("
+						<< t.converted / elapsed << " files/s), latency mean "
+						<< (t.converted ? t.total_latency / t.converted : 0) << " ms, max " << t.max_latency << " ms\n";
+	return t.failed ? 2 : 0;
+}
+
+#else
+
+int watch::run(const std::string &, const matlab::options &, unsigned, cache::directory *, bool)
+{
+	std::cerr << "error: watch mode requires inotify (Linux)\n";
+	return 2;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include <catch2/catch_test_macros.hpp>
+#include "mathcadconvert.h"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using sv = std::string_view;
+using context = std::unique_ptr<mcc_context, decltype(&mcc_destroy)>;
+
+// x := a * 2 / b, with a defined and b not
+static std::string worksheet(int n)
+{
+	return R"(<?xml version="1.0"?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30"><regions>)"
+		   R"(<region region-id="1"><math><ml:define><ml:id>a</ml:id><ml:real>)" + std::to_string(n) + R"(</ml:real></ml:define></math></region>)"
+		   R"(<region region-id="2"><math><ml:define><ml:id>x</ml:id><ml:apply><ml:div/><ml:apply><ml:mult/><ml:id>a</ml:id><ml:real>2</ml:real></ml:apply><ml:id>b</ml:id></ml:apply></ml:define></math></region>)"
+		   R"(</regions></worksheet>)";
+}
+static std::string script(int n)
+{
+	return "a = " + std::to_string(n) + ";\nx = a * 2 / b;\n";
+}
+
+TEST_CASE("c api")
+{
+	context ctx(mcc_create(), mcc_destroy);
+	REQUIRE(ctx);
+	const auto xml = worksheet(3);
+
+	SECTION("library-owned output")
+	{
+		const char *out = nullptr;
+		std::size_t size = 0;
+		REQUIRE(mcc_convert(ctx.get(), xml.data(), xml.size(), &out, &size) == MCC_OK);
+		CHECK(sv(out, size) == script(3));
+		CHECK(out[size] == '\0');
+		REQUIRE(mcc_undefined_id_count(ctx.get()) == 1);
+		CHECK(sv(mcc_undefined_id(ctx.get(), 0)) == "b");
+		CHECK(mcc_undefined_id(ctx.get(), 1) == nullptr);
+		CHECK(sv(mcc_last_error(ctx.get())).empty());
+	}
+	SECTION("caller-provided output")
+	{
+		char small[4];
+		std::size_t size = 0;
+		REQUIRE(mcc_convert_into(ctx.get(), xml.data(), xml.size(), small, sizeof(small), &size) == MCC_BUFFER_TOO_SMALL);
+		REQUIRE(size == script(3).size());
+		std::string buffer(size, '\0');
+		REQUIRE(mcc_copy_script(ctx.get(), buffer.data(), buffer.size(), &size) == MCC_OK);
+		CHECK(buffer == script(3));
+		REQUIRE(mcc_convert_into(ctx.get(), xml.data(), xml.size(), buffer.data(), buffer.size(), &size) == MCC_OK);
+		CHECK(buffer == script(3));
+	}
+	SECTION("options")
+	{
+		REQUIRE(mcc_set_cse_threshold(ctx.get(), 1) == MCC_OK);
+		const auto twice = R"(<?xml version="1.0"?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30"><regions><region><math>)"
+						   R"(<ml:define><ml:id>x</ml:id><ml:apply><ml:plus/><ml:apply><ml:sqrt/><ml:id>a</ml:id></ml:apply><ml:apply><ml:sqrt/><ml:id>a</ml:id></ml:apply></ml:apply></ml:define>)"
+						   R"(</math></region></regions></worksheet>)";
+		const char *out = nullptr;
+		std::size_t size = 0;
+		REQUIRE(mcc_convert(ctx.get(), twice, std::char_traits<char>::length(twice), &out, &size) == MCC_OK);
+		CHECK(sv(out, size) == "cse1 = sqrt(a);\nx = cse1 + cse1;\n");
+		std::size_t temporaries = 0;
+		mcc_cse_stats(ctx.get(), &temporaries, nullptr);
+		CHECK(temporaries == 1);
+	}
+	SECTION("errors")
+	{
+		const char *out = nullptr;
+		std::size_t size = 0;
+		const sv broken = "<worksheet><regions>";
+		CHECK(mcc_convert(ctx.get(), broken.data(), broken.size(), &out, &size) == MCC_PARSE_ERROR);
+		CHECK_FALSE(sv(mcc_last_error(ctx.get())).empty());
+		CHECK(mcc_convert(nullptr, xml.data(), xml.size(), &out, &size) == MCC_INVALID_ARGUMENT);
+		CHECK(mcc_convert(ctx.get(), xml.data(), xml.size(), nullptr, &size) == MCC_INVALID_ARGUMENT);
+	}
+}
+
+TEST_CASE("c api contexts are independent across threads")
+{
+	constexpr int threads = 8;
+	std::vector<int> failures(threads);
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; ++t)
+		pool.emplace_back([t, &failures]
+		{
+			context ctx(mcc_create(), mcc_destroy);
+			for (int i = 0; i < 200; ++i)
+			{
+				const auto xml = worksheet(t * 1000 + i);
+				const char *out = nullptr;
+				std::size_t size = 0;
+				if (mcc_convert(ctx.get(), xml.data(), xml.size(), &out, &size) != MCC_OK || sv(out, size) != script(t * 1000 + i) || mcc_undefined_id_count(ctx.get()) != 1)
+					++failures[t];
+			}
+		});
+	for (auto &t : pool)
+		t.join();
+	CHECK(failures == std::vector<int>(threads));
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+#include "cache.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+TEST_CASE("xxh64")
+{
+	CHECK(cache::hash("") == 0xEF46DB3751D8E999);
+	CHECK(cache::hash("a") == 0xD24EC4F1A98C6E5B);
+	CHECK(cache::hash("abc") == 0x44BC2CF5AD770999);
+	// long enough for the 32 byte stripes
+	CHECK(cache::hash("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1);
+	CHECK(cache::hash("abc", 1) != cache::hash("abc"));
+}
+
+TEST_CASE("cache directory")
+{
+	const auto root = fs::temp_directory_path() / ("mathcadconvert_cache_test_" + std::to_string(cache::hash(__TIME__)));
+	fs::remove_all(root);
+
+	const std::string input = "<worksheet/>";
+	const std::string script = "a = 1;\nb = a + c;\n";
+	std::ostringstream os;
+	std::vector<std::string> ids;
+	{
+		cache::directory cache(root, 1 << 20, "matlab 1");
+		const auto key = cache.key(input);
+		CHECK_FALSE(cache.load(key, input.size(), os, ids));
+		CHECK(os.str().empty());
+
+		cache.store(key, input.size(), script, {"c"});
+		CHECK(cache.load(key, input.size(), os, ids));
+		CHECK(os.str() == script);
+		CHECK(ids == std::vector<std::string>{"c"});
+
+		SECTION("a different input size is a miss")
+		{
+			std::ostringstream other;
+			CHECK_FALSE(cache.load(key, input.size() + 1, other, ids));
+		}
+	}
+
+	SECTION("entries persist")
+	{
+		cache::directory cache(root, 1 << 20, "matlab 1");
+		std::ostringstream again;
+		CHECK(cache.load(cache.key(input), input.size(), again, ids));
+		CHECK(again.str() == script);
+	}
+
+	SECTION("different settings miss")
+	{
+		cache::directory cache(root, 1 << 20, "matlab 2");
+		std::ostringstream again;
+		CHECK_FALSE(cache.load(cache.key(input), input.size(), again, ids));
+	}
+
+	SECTION("least recently used entries are evicted")
+	{
+		cache::directory cache(root, 4096, "matlab 1");
+		const std::string big(1000, 'x');
+		for (int i = 0; i < 10; ++i)
+			cache.store(cache.key(std::to_string(i)), 1, big, {});
+		std::size_t total = 0, entries = 0;
+		for (auto &e : fs::recursive_directory_iterator(root))
+			if (e.is_regular_file())
+				total += e.file_size(), ++entries;
+		CHECK(total <= 4096);
+		CHECK(entries < 10);
+		std::ostringstream last;
+		CHECK(cache.load(cache.key("9"), 1, last, ids));
+	}
+
+	SECTION("entries being written are left alone")
+	{
+		fs::create_directories(root / "ab");
+		const auto writing = root / "ab" / "abababababababab.tmp123";
+		std::ofstream(writing) << std::string(8192, 'x');
+		const auto crashed = root / "ab" / "abababababababab.tmp456";
+		std::ofstream(crashed) << "x";
+		fs::last_write_time(crashed, fs::file_time_type::clock::now() - std::chrono::hours(2));
+		cache::directory cache(root, 4096, "matlab 1");
+		cache.store(cache.key("big"), 1, std::string(5000, 'x'), {});
+		CHECK(fs::exists(writing));
+		CHECK_FALSE(fs::exists(crashed));
+	}
+
+	fs::remove_all(root);
+}
@@ -0,0 +1,238 @@
+#include <catch2/catch_test_macros.hpp>
+#include "pugixml.hpp"
+#include "check.hpp"
+#include <string>
+
+using sv = std::string_view;
+
+TEST_CASE("check results")
+{
+	pugi::xml_document doc;
+
+	// wraps each statement in its own region, numbered from 1
+	const auto run = [&doc](std::initializer_list<sv> statements)
+	{
+		std::string xml = R"(<?xml?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30"><regions>)";
+		int id = 1;
+		for (auto s : statements)
+		{
+			xml += "<region region-id=\"" + std::to_string(id++) + "\"><math>";
+			xml += s;
+			xml += "</math></region>";
+		}
+		xml += "</regions></worksheet>";
+		REQUIRE(doc.load_string(xml.c_str()));
+		return check::worksheet(doc);
+	};
+
+	SECTION("arithmetic")
+	{
+		auto report = run({R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:plus/>
+				<ml:real>1</ml:real>
+				<ml:apply>
+					<ml:mult/>
+					<ml:real>2</ml:real>
+					<ml:apply>
+						<ml:pow/>
+						<ml:real>3</ml:real>
+						<ml:real>2</ml:real>
+					</ml:apply>
+				</ml:apply>
+			</ml:apply>
+			<result><ml:real>19</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.empty());
+	}
+	SECTION("definitions and units")
+	{
+		auto report = run({R"(
+		<ml:define>
+			<ml:id>I</ml:id>
+			<ml:apply>
+				<ml:mult/>
+				<ml:real>18</ml:real>
+				<ml:id>mA</ml:id>
+			</ml:apply>
+		</ml:define>
+		)",
+											 R"(
+		<ml:define>
+			<ml:id subscript="r">T</ml:id>
+			<ml:eval>
+				<ml:apply>
+					<ml:mult/>
+					<ml:id>I</ml:id>
+					<ml:real>1000</ml:real>
+				</ml:apply>
+				<result>
+					<unitedValue>
+						<ml:real>18</ml:real>
+						<unitMonomial><unitReference unit="ampere"/></unitMonomial>
+					</unitedValue>
+				</result>
+			</ml:eval>
+		</ml:define>
+		)",
+											 R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:mult/>
+				<ml:real>180</ml:real>
+				<ml:id>°</ml:id>
+			</ml:apply>
+			<result><ml:real>3.14159265358979</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 2);
+		REQUIRE(report.mismatches.empty());
+	}
+	SECTION("complex")
+	{
+		auto report = run({R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:id>sqrt</ml:id>
+				<ml:real>-4</ml:real>
+			</ml:apply>
+			<result><ml:imag symbol="i">2</ml:imag></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.empty());
+	}
+	SECTION("functions and if")
+	{
+		auto report = run({R"(
+		<ml:define>
+			<ml:function>
+				<ml:id>f</ml:id>
+				<ml:boundVars><ml:id>z</ml:id></ml:boundVars>
+			</ml:function>
+			<ml:apply>
+				<ml:id>if</ml:id>
+				<ml:sequence>
+					<ml:apply>
+						<ml:greaterThan/>
+						<ml:id>z</ml:id>
+						<ml:real>2</ml:real>
+					</ml:apply>
+					<ml:id>z</ml:id>
+					<ml:apply>
+						<ml:neg/>
+						<ml:id>z</ml:id>
+					</ml:apply>
+				</ml:sequence>
+			</ml:apply>
+		</ml:define>
+		)",
+											 R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:plus/>
+				<ml:apply><ml:id>f</ml:id><ml:real>3</ml:real></ml:apply>
+				<ml:apply><ml:id>f</ml:id><ml:real>1</ml:real></ml:apply>
+			</ml:apply>
+			<result><ml:real>2</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.empty());
+	}
+	SECTION("ranges and indexing")
+	{
+		auto report = run({R"(
+		<ml:define>
+			<ml:id>n</ml:id>
+			<ml:range>
+				<ml:real>0</ml:real>
+				<ml:real>4</ml:real>
+			</ml:range>
+		</ml:define>
+		)",
+											 R"(
+		<ml:define>
+			<ml:id>w</ml:id>
+			<ml:apply>
+				<ml:pow/>
+				<ml:id>n</ml:id>
+				<ml:real>2</ml:real>
+			</ml:apply>
+		</ml:define>
+		)",
+											 R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:indexer/>
+				<ml:id>w</ml:id>
+				<ml:real>3</ml:real>
+			</ml:apply>
+			<result><ml:real>9</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.empty());
+	}
+	SECTION("values that Mathcad shows as zero")
+	{
+		auto report = run({R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:id>sin</ml:id>
+				<ml:id>π</ml:id>
+			</ml:apply>
+			<result><ml:real>0</ml:real></result>
+		</ml:eval>
+		)",
+											 R"(
+		<ml:eval>
+			<ml:real>1e-12</ml:real>
+			<result><ml:real>0</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 2);
+		REQUIRE(report.mismatches.size() == 1);
+		REQUIRE(report.mismatches[0].region == "2");
+	}
+	SECTION("mismatch is reported with its region")
+	{
+		auto report = run({R"(
+		<ml:define>
+			<ml:id>x</ml:id>
+			<ml:real>2</ml:real>
+		</ml:define>
+		)",
+											 R"(
+		<ml:eval>
+			<ml:apply>
+				<ml:div/>
+				<ml:id>x</ml:id>
+				<ml:real>4</ml:real>
+			</ml:apply>
+			<result><ml:real>0.6</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.size() == 1);
+		REQUIRE(report.mismatches[0].region == "2");
+		REQUIRE(report.mismatches[0].expected == "0.6");
+		REQUIRE(report.mismatches[0].actual == "0.5");
+	}
+	SECTION("undefined id is reported as an error")
+	{
+		auto report = run({R"(
+		<ml:eval>
+			<ml:id>nope</ml:id>
+			<result><ml:real>1</ml:real></result>
+		</ml:eval>
+		)"});
+		REQUIRE(report.checked == 1);
+		REQUIRE(report.mismatches.size() == 1);
+		REQUIRE(report.mismatches[0].region == "1");
+		REQUIRE(report.mismatches[0].actual == "error: 'nope' is not defined");
+	}
+}
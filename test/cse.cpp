@@ -0,0 +1,116 @@
+#include <catch2/catch_test_macros.hpp>
+#include "pugixml.hpp"
+#include "matlab.hpp"
+#include <sstream>
+#include <string>
+
+using sv = std::string_view;
+
+// a := 2
+static const sv define_a = R"(<ml:define><ml:id>a</ml:id><ml:real>2</ml:real></ml:define>)";
+// sqrt(a + 1), 6 nodes
+static const std::string sqrt_a1 = R"(<ml:apply><ml:sqrt/><ml:apply><ml:plus/><ml:id>a</ml:id><ml:real>1</ml:real></ml:apply></ml:apply>)";
+
+static std::string define(sv name, sv op, const std::string &lhs, sv rhs)
+{
+	return "<ml:define><ml:id>" + std::string(name) + "</ml:id><ml:apply><" + std::string(op) + "/>" + lhs + std::string(rhs) + "</ml:apply></ml:define>";
+}
+
+TEST_CASE("common subexpression elimination")
+{
+	pugi::xml_document doc;
+	matlab::context ctx;
+
+	const auto run = [&doc, &ctx](std::initializer_list<std::string> statements, std::size_t threshold)
+	{
+		std::string xml = R"(<?xml?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30"><regions>)";
+		for (auto &s : statements)
+			xml += "<region><math>" + s + "</math></region>";
+		xml += "</regions></worksheet>";
+		REQUIRE(doc.load_string(xml.c_str()));
+		ctx.opts.cse_threshold = threshold;
+		std::ostringstream os;
+		ctx.convert(doc, os);
+		return os.str();
+	};
+
+	SECTION("repeated subexpression is hoisted after its dependency")
+	{
+		auto out = run({std::string(define_a),
+										define("x", "ml:mult", sqrt_a1, "<ml:real>3</ml:real>"),
+										define("y", "ml:div", sqrt_a1, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "a = 2;\ncse1 = sqrt(a + 1);\nx = cse1 * 3;\ny = cse1 / 2;\n");
+		REQUIRE(ctx.get_cse_stats());
+		REQUIRE(ctx.get_cse_stats()->temporaries == 1);
+		REQUIRE(ctx.get_cse_stats()->deduplicated == 6);
+	}
+	SECTION("below threshold is left alone")
+	{
+		auto out = run({std::string(define_a),
+										define("x", "ml:mult", sqrt_a1, "<ml:real>3</ml:real>"),
+										define("y", "ml:div", sqrt_a1, "<ml:real>2</ml:real>")},
+									 7);
+		REQUIRE(out == "a = 2;\nx = sqrt(a + 1) * 3;\ny = sqrt(a + 1) / 2;\n");
+		REQUIRE(ctx.get_cse_stats());
+		REQUIRE(ctx.get_cse_stats()->deduplicated == 0);
+	}
+	SECTION("redefinition separates uses")
+	{
+		auto out = run({std::string(define_a),
+										define("x", "ml:mult", sqrt_a1, "<ml:real>3</ml:real>"),
+										std::string(define_a),
+										define("y", "ml:div", sqrt_a1, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "a = 2;\nx = sqrt(a + 1) * 3;\na = 2;\ny = sqrt(a + 1) / 2;\n");
+	}
+	SECTION("nested uses are counted once")
+	{
+		const auto twice = "<ml:apply><ml:mult/>" + sqrt_a1 + "<ml:id>b</ml:id></ml:apply>";
+		auto out = run({std::string(define_a),
+										define("x", "ml:plus", twice, "<ml:real>3</ml:real>"),
+										define("y", "ml:minus", twice, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "a = 2;\ncse1 = sqrt(a + 1) * b;\nx = cse1 + 3;\ny = cse1 - 2;\n");
+		REQUIRE(ctx.get_cse_stats());
+		REQUIRE(ctx.get_cse_stats()->temporaries == 1);
+	}
+	SECTION("inner and outer temporaries")
+	{
+		const auto twice = "<ml:apply><ml:mult/>" + sqrt_a1 + "<ml:id>b</ml:id></ml:apply>";
+		auto out = run({std::string(define_a),
+										define("x", "ml:plus", twice, "<ml:real>3</ml:real>"),
+										define("y", "ml:minus", twice, "<ml:real>2</ml:real>"),
+										define("z", "ml:div", sqrt_a1, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "a = 2;\ncse2 = sqrt(a + 1);\ncse1 = cse2 * b;\nx = cse1 + 3;\ny = cse1 - 2;\nz = cse2 / 2;\n");
+	}
+	SECTION("bound variables are not hoisted")
+	{
+		const auto body = R"(<ml:apply><ml:sqrt/><ml:apply><ml:plus/><ml:id>z</ml:id><ml:real>1</ml:real></ml:apply></ml:apply>)";
+		const auto function = [&body](sv name)
+		{
+			return "<ml:define><ml:function><ml:id>" + std::string(name) + "</ml:id><ml:boundVars><ml:id>z</ml:id></ml:boundVars></ml:function>" + body + "</ml:define>";
+		};
+		auto out = run({function("f"), function("g")}, 1);
+		REQUIRE(out == "f = @(z) sqrt(z + 1);\ng = @(z) sqrt(z + 1);\n");
+	}
+	SECTION("range variables are not hoisted")
+	{
+		const auto range = R"(<ml:define><ml:id>n</ml:id><ml:range><ml:real>0</ml:real><ml:real>3</ml:real></ml:range></ml:define>)";
+		const auto n2 = R"(<ml:apply><ml:mult/><ml:id>n</ml:id><ml:real>2</ml:real></ml:apply>)";
+		auto out = run({range,
+										define("x", "ml:plus", n2, "<ml:real>3</ml:real>"),
+										define("y", "ml:minus", n2, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "n = ((0:3) + ARRAY_OFFSET);\nx = n * 2 + 3;\ny = n * 2 - 2;\n");
+	}
+	SECTION("impure functions are not hoisted")
+	{
+		const auto rnd = R"(<ml:apply><ml:id>rnd</ml:id><ml:real>1</ml:real></ml:apply>)";
+		auto out = run({define("x", "ml:plus", rnd, "<ml:real>3</ml:real>"),
+										define("y", "ml:minus", rnd, "<ml:real>2</ml:real>")},
+									 1);
+		REQUIRE(out == "x = rnd(1) + 3;\ny = rnd(1) - 2;\n");
+	}
+}
@@ -0,0 +1,172 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include "pugixml.hpp"
+#include "extract.hpp"
+#include "matlab.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+using sv = std::string_view;
+
+static std::string encode(sv bytes)
+{
+	static constexpr sv alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string text;
+	for (std::size_t i = 0; i < bytes.size(); i += 3)
+	{
+		std::uint32_t group = static_cast<unsigned char>(bytes[i]) << 16;
+		if (i + 1 < bytes.size())
+			group |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+		if (i + 2 < bytes.size())
+			group |= static_cast<unsigned char>(bytes[i + 2]);
+		text += alphabet[group >> 18];
+		text += alphabet[group >> 12 & 63];
+		text += i + 1 < bytes.size() ? alphabet[group >> 6 & 63] : '=';
+		text += i + 2 < bytes.size() ? alphabet[group & 63] : '=';
+	}
+	return text;
+}
+
+// decodes all of text through a buffer of the given size, as extraction does
+static std::string decode(sv text, std::size_t buffer_size, sv &rest, extract::kernel k)
+{
+	std::string bytes;
+	std::string buffer(buffer_size, '\0');
+	while (const auto n = extract::base64(text, buffer.data(), buffer.size(), k))
+		bytes.append(buffer, 0, n);
+	rest = text;
+	return bytes;
+}
+
+TEST_CASE("base64")
+{
+	const auto k = GENERATE(extract::kernel::avx2, extract::kernel::ssse3, extract::kernel::scalar);
+	if (!extract::supported(k))
+		SKIP("kernel not supported here");
+	const auto decode = [k](sv text, std::size_t buffer_size, sv &rest) { return ::decode(text, buffer_size, rest, k); };
+	sv rest;
+	CHECK(decode("", 64, rest).empty());
+	CHECK(decode("TWFu", 64, rest) == "Man");
+	CHECK(decode("TWE=", 64, rest) == "Ma");
+	CHECK(rest == "=");
+	CHECK(decode("TQ==", 64, rest) == "M");
+	CHECK(decode("TW\r\nFu\n", 64, rest) == "Man");
+	CHECK(rest.empty());
+
+	SECTION("every length through the vector paths, as the scalar decoder")
+	{
+		std::string bytes;
+		for (int i = 0; i < 1000; ++i)
+			bytes += static_cast<char>(i * 37 + i / 7);
+		for (std::size_t n = 0; n < bytes.size(); n += 7)
+		{
+			const auto text = encode(sv(bytes).substr(0, n));
+			for (std::size_t buffer_size : {3, 40, 100, 4096})
+			{
+				CHECK(decode(text, buffer_size, rest) == sv(bytes).substr(0, n));
+				CHECK(rest.find_first_not_of('=') == sv::npos);
+				sv scalar_rest;
+				CHECK(decode(text, buffer_size, rest) == ::decode(text, buffer_size, scalar_rest, extract::kernel::scalar));
+				CHECK(rest == scalar_rest);
+			}
+		}
+	}
+	SECTION("line breaks")
+	{
+		const std::string bytes(3000, '\x5a');
+		auto text = encode(bytes);
+		for (std::size_t i = 76; i < text.size(); i += 78)
+			text.insert(i, "\r\n");
+		CHECK(decode(text, 1000, rest) == bytes);
+		CHECK(rest.empty());
+	}
+	SECTION("stops at characters outside the alphabet")
+	{
+		auto text = encode(std::string(300, 'x'));
+		text[200] = '*';
+		const auto bytes = decode(text, 4096, rest);
+		CHECK(bytes == std::string(150, 'x'));
+		CHECK(rest.front() == '*');
+	}
+}
+
+TEST_CASE("binaryContent extraction")
+{
+	const std::string png = std::string("\x89PNG\r\n\x1a\n", 8) + std::string(100000, '\x07');
+	const std::string data(5000, '\x42');
+	const std::string xml = R"(<?xml?><worksheet><regions><region region-id="1"><plot disable-calc="false" item-idref="2"/></region><region region-id="3"><plot disable-calc="false" item-idref="4"/></region></regions><binaryContent>)"
+		"<item item-id=\"2\" content-encoding=\"none\">" + encode(png) + "</item>"
+		"<item item-id=\"4\" content-encoding=\"none\">" + encode(data) + "</item>"
+		"</binaryContent></worksheet>";
+	pugi::xml_document doc;
+	REQUIRE(doc.load_string(xml.c_str()));
+
+	CHECK(extract::file_name(extract::find_item(doc, "2")) == "2.png");
+	CHECK(extract::file_name(extract::find_item(doc, "4")) == "4.bin");
+	CHECK_FALSE(extract::find_item(doc, "3"));
+
+	const auto dir = fs::temp_directory_path() / "mathcadconvert_extract_test";
+	fs::remove_all(dir);
+	const auto check_files = [&]
+	{
+		const auto contents = [](const fs::path &path)
+		{
+			std::ifstream in(path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(in), {});
+		};
+		CHECK(contents(dir / "2.png") == png);
+		CHECK(contents(dir / "4.bin") == data);
+		fs::remove_all(dir);
+	};
+
+	SECTION("items")
+	{
+		CHECK(extract::items(doc, dir));
+		check_files();
+	}
+	SECTION("in the background")
+	{
+		extract::background extractor;
+		extractor.start(doc, dir);
+		CHECK(extractor.wait());
+		check_files();
+	}
+
+	SECTION("item-ids that are not plain names are not extracted")
+	{
+		const std::string hostile = R"(<?xml?><worksheet><regions><region region-id="1"><plot item-idref="../../escaped"/></region></regions><binaryContent>)"
+			"<item item-id=\"../../escaped\">" + encode(data) + "</item>"
+			"<item item-id=\"a/b\">" + encode(data) + "</item>"
+			"<item item-id=\"x');delete('y\">" + encode(data) + "</item>"
+			"<item item-id=\"\">" + encode(data) + "</item>"
+			"<item item-id=\"ok\">" + encode(data) + "</item>"
+			"</binaryContent></worksheet>";
+		pugi::xml_document bad;
+		REQUIRE(bad.load_string(hostile.c_str()));
+		const auto inner = dir / "a" / "b";
+		CHECK_FALSE(extract::items(bad, inner));
+		CHECK(fs::exists(inner / "ok.bin"));
+		CHECK(std::distance(fs::recursive_directory_iterator(dir), {}) == 3);
+		CHECK(extract::file_name(extract::find_item(bad, "x');delete('y")).empty());
+
+		std::ostringstream os;
+		matlab::context ctx;
+		ctx.binary_dir = "sheet_files";
+		ctx.convert(bad, os);
+		CHECK(os.str() == "% a mathcad plot was here but there is no good way to know what was in it\n");
+		fs::remove_all(dir);
+	}
+	SECTION("plots refer to the extracted files")
+	{
+		std::ostringstream os;
+		matlab::context ctx;
+		ctx.binary_dir = "sheet_files";
+		ctx.convert(doc, os);
+		CHECK(os.str() == "figure; imshow(imread('sheet_files/2.png')); % a mathcad plot\n"
+											"% a mathcad plot was here; its data was extracted to 'sheet_files/4.bin'\n");
+	}
+}
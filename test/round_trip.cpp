@@ -0,0 +1,213 @@
+#include <catch2/catch_test_macros.hpp>
+#include "pugixml.hpp"
+#include "matlab.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+
+using sv = std::string_view;
+
+// Parses the MATLAB subset emitted for expressions back into a prefix tree
+// string, e.g. "a - (b - c)" -> "(- a (- b c))". Parentheses do not appear
+// in the output, so two expressions compare equal only if MATLAB would
+// evaluate them the same way. Text that does not parse yields "".
+class matlab_parser
+{
+	sv s;
+	size_t i = 0;
+	bool failed = false;
+	bool strict = false;
+
+	void ws()
+	{
+		while (i < s.size() && s[i] == ' ')
+			++i;
+	}
+	sv peek_op()
+	{
+		ws();
+		for (const sv op : {"==", "+", "-", "*", "/", "^", ">", "<"})
+			if (s.substr(i, op.size()) == op)
+				return op;
+		return {};
+	}
+	static int binary_precedence(sv op)
+	{
+		if (op == "==" || op == ">" || op == "<")
+			return 0;
+		if (op == "+" || op == "-")
+			return 1;
+		if (op == "*" || op == "/")
+			return 2;
+		if (op == "^")
+			return 4;
+		return -1;
+	}
+	std::string primary()
+	{
+		ws();
+		if (i < s.size() && s[i] == '(')
+		{
+			++i;
+			auto e = expression(0);
+			ws();
+			failed |= i >= s.size() || s[i] != ')';
+			++i;
+			return e;
+		}
+		const auto start = i;
+		while (i < s.size() && (std::isalnum(static_cast<unsigned char>(s[i])) || s[i] == '_' || s[i] == '.'))
+			++i;
+		failed |= i == start;
+		return std::string(s.substr(start, i - start));
+	}
+	// unary minus binds looser than ^ but tighter than * and /, except
+	// directly after ^ where it only applies to the following primary
+	std::string unary()
+	{
+		if (peek_op() == "-")
+		{
+			++i;
+			return "(neg " + unary() + ")";
+		}
+		return power();
+	}
+	std::string power()
+	{
+		return power(primary());
+	}
+	std::string power(std::string lhs)
+	{
+		while (peek_op() == "^")
+		{
+			++i;
+			auto rhs = peek_op() == "-" ? (++i, "(neg " + signed_exponent() + ")") : primary();
+			lhs = "(^ " + lhs + " " + rhs + ")";
+		}
+		return lhs;
+	}
+	// MATLAB groups the powers after ^- from the right, so a^-b^c is
+	// a^(-(b^c)); strict rejects this, as MATLAB advises parentheses instead
+	std::string signed_exponent()
+	{
+		auto base = primary();
+		if (peek_op() != "^")
+			return base;
+		failed |= strict;
+		return power(std::move(base));
+	}
+	std::string expression(int min)
+	{
+		auto lhs = unary();
+		for (;;)
+		{
+			const auto op = peek_op();
+			const auto p = binary_precedence(op);
+			if (op.empty() || op == "^" || p < min)
+				return lhs;
+			i += op.size();
+			auto rhs = expression(p + 1);
+			lhs = "(" + std::string(op) + " " + lhs + " " + rhs + ")";
+		}
+	}
+
+public:
+	static std::string parse(sv text, bool strict = false)
+	{
+		matlab_parser p;
+		p.s = text;
+		p.strict = strict;
+		auto tree = p.expression(0);
+		p.ws();
+		if (p.failed || p.i != text.size())
+			return {};
+		return tree;
+	}
+};
+
+struct expr
+{
+	std::string xml;
+	std::string tree;
+};
+
+static std::vector<expr> leaves()
+{
+	return {
+			{"<ml:id>a</ml:id>", "a"},
+			{"<ml:real>2</ml:real>", "2"},
+			{"<ml:real>-1</ml:real>", "(neg 1)"},
+	};
+}
+
+// every expression whose operands are taken from the given list
+static std::vector<expr> combine(const std::vector<expr> &operands)
+{
+	const std::pair<sv, sv> ops[] = {
+			{"ml:plus", "+"},
+			{"ml:minus", "-"},
+			{"ml:mult", "*"},
+			{"ml:div", "/"},
+			{"ml:pow", "^"},
+			{"ml:equal", "=="},
+			{"ml:greaterThan", ">"},
+			{"ml:lessThan", "<"},
+	};
+	std::vector<expr> out = operands;
+	for (const auto &a : operands)
+		out.push_back({"<ml:apply><ml:neg/>" + a.xml + "</ml:apply>", "(neg " + a.tree + ")"});
+	for (const auto &[tag, op] : ops)
+		for (const auto &a : operands)
+			for (const auto &b : operands)
+				out.push_back({"<ml:apply><" + std::string(tag) + "/>" + a.xml + b.xml + "</ml:apply>",
+											 "(" + std::string(op) + " " + a.tree + " " + b.tree + ")"});
+	return out;
+}
+
+TEST_CASE("printed expressions parse to the same tree")
+{
+	const auto exprs = combine(combine(leaves()));
+	for (const auto &e : exprs)
+	{
+		pugi::xml_document doc;
+		REQUIRE(doc.load_string(e.xml.c_str()));
+		std::ostringstream os;
+		matlab::convert(doc.first_child(), os);
+		INFO(os.str());
+		REQUIRE(matlab_parser::parse(os.str()) == e.tree);
+	}
+}
+
+TEST_CASE("printer emits no redundant parentheses")
+{
+	const auto exprs = combine(combine(leaves()));
+	for (const auto &e : exprs)
+	{
+		pugi::xml_document doc;
+		REQUIRE(doc.load_string(e.xml.c_str()));
+		std::ostringstream os;
+		matlab::convert(doc.first_child(), os);
+		const auto printed = os.str();
+
+		// dropping any single pair of parentheses must change the parsed tree
+		// or make the text unparseable, or rely on how MATLAB groups ^-
+		for (size_t open = printed.find('('); open != std::string::npos; open = printed.find('(', open + 1))
+		{
+			int depth = 0;
+			size_t close = open;
+			for (; close < printed.size(); ++close)
+			{
+				depth += printed[close] == '(';
+				depth -= printed[close] == ')';
+				if (depth == 0)
+					break;
+			}
+			auto stripped = printed;
+			stripped.erase(close, 1);
+			stripped.erase(open, 1);
+			INFO(printed << " -> " << stripped);
+			REQUIRE(matlab_parser::parse(stripped, true) != e.tree);
+		}
+	}
+}
@@ -49,9 +49,9 @@ TEST_CASE("simple xml tags")
 						SECTION("matlab")
 						{
 							matlab::convert(apply_tag, os);
-							std::string result = "(0.039 ";
+							std::string result = "0.039 ";
 							result += op_str;
-							result += " V_t)";
+							result += " V_t";
 							REQUIRE(os.str() == result);
 						}
 		}
@@ -126,7 +126,7 @@ TEST_CASE("simple xml tags")
 		REQUIRE(sv(apply_mult.name()) == "ml:apply");
 		REQUIRE(sv(apply_mult.first_child().name()) == "ml:mult");
 
-		run_test(apply_mult, "(0.039 * V_t)");
+		run_test(apply_mult, "0.039 * V_t");
 	}
 	SECTION("apply pow explicit")
 	{
@@ -141,7 +141,7 @@ TEST_CASE("simple xml tags")
 		REQUIRE(sv(apply_mult.name()) == "ml:apply");
 		REQUIRE(sv(apply_mult.first_child().name()) == "ml:pow");
 
-		run_test(apply_mult, "(0.039^V_t)");
+		run_test(apply_mult, "0.039^V_t");
 	}
 	SECTION("apply abs")
 	{
@@ -180,7 +180,7 @@ TEST_CASE("simple xml tags")
 	REQUIRE(sv(define.name()) == "ml:define");
 	REQUIRE(sv(define.first_child().name()) == "ml:id");
 
-	run_test(define, "ID = (18 * mA)");
+	run_test(define, "ID = 18 * mA");
     }
     SECTION("p comment")
     {
@@ -268,7 +268,7 @@ TEST_CASE("simple xml tags")
         REQUIRE(sv(eval.name()) == "math");
     	REQUIRE(sv(eval.first_child().name()) == "ml:define");
 
-    	run_test(eval, "T_r = (3 * °); \% expected result: 0.5;\n");
+    	run_test(eval, "T_r = 3 * °; \% expected result: 0.5;\n");
     }
     SECTION("apply neg")
     {
@@ -282,7 +282,102 @@ TEST_CASE("simple xml tags")
         REQUIRE(sv(apply.name()) == "ml:apply");
     	REQUIRE(sv(apply.first_child().name()) == "ml:neg");
 
-    	run_test(apply, "(-hello)");
+    	run_test(apply, "-hello");
+    }
+    SECTION("apply nested precedence")
+    {
+    	const sv xml = R"(
+    	<ml:apply>
+    	    <ml:mult/>
+    	    <ml:apply>
+    	        <ml:plus/>
+    	        <ml:id>a</ml:id>
+    	        <ml:id>b</ml:id>
+    	    </ml:apply>
+    	    <ml:apply>
+    	        <ml:pow/>
+    	        <ml:id>c</ml:id>
+    	        <ml:real>2</ml:real>
+    	    </ml:apply>
+    	</ml:apply>
+        )";
+        auto apply = init_tag(xml);
+        REQUIRE(sv(apply.name()) == "ml:apply");
+
+    	run_test(apply, "(a + b) * c^2");
+    }
+    SECTION("apply nested right operand")
+    {
+    	const sv xml = R"(
+    	<ml:apply>
+    	    <ml:minus/>
+    	    <ml:id>a</ml:id>
+    	    <ml:apply>
+    	        <ml:minus/>
+    	        <ml:id>b</ml:id>
+    	        <ml:id>c</ml:id>
+    	    </ml:apply>
+    	</ml:apply>
+        )";
+        auto apply = init_tag(xml);
+        REQUIRE(sv(apply.name()) == "ml:apply");
+
+    	run_test(apply, "a - (b - c)");
+    }
+    SECTION("apply nested left operand")
+    {
+    	const sv xml = R"(
+    	<ml:apply>
+    	    <ml:minus/>
+    	    <ml:apply>
+    	        <ml:minus/>
+    	        <ml:id>a</ml:id>
+    	        <ml:id>b</ml:id>
+    	    </ml:apply>
+    	    <ml:id>c</ml:id>
+    	</ml:apply>
+        )";
+        auto apply = init_tag(xml);
+        REQUIRE(sv(apply.name()) == "ml:apply");
+
+    	run_test(apply, "a - b - c");
+    }
+    SECTION("apply pow of neg")
+    {
+    	const sv xml = R"(
+    	<ml:apply>
+    	    <ml:pow/>
+    	    <ml:real>-2</ml:real>
+    	    <ml:apply>
+    	        <ml:neg/>
+    	        <ml:id>x</ml:id>
+    	    </ml:apply>
+    	</ml:apply>
+        )";
+        auto apply = init_tag(xml);
+        REQUIRE(sv(apply.name()) == "ml:apply");
+
+    	run_test(apply, "(-2)^-x");
+    }
+    SECTION("apply keeps explicit parens")
+    {
+    	const sv xml = R"(
+    	<ml:apply>
+    	    <ml:plus/>
+    	    <ml:parens>
+    	        <ml:apply>
+    	            <ml:mult/>
+    	            <ml:id>a</ml:id>
+    	            <ml:id>b</ml:id>
+    	        </ml:apply>
+    	    </ml:parens>
+    	    <ml:id>c</ml:id>
+    	</ml:apply>
+        )";
+        auto apply = init_tag(xml);
+        REQUIRE(sv(apply.name()) == "ml:apply");
+
+    	run_test(apply, "(a * b) + c");
     }
     SECTION("apply dunno one arg")
     {
@@ -464,7 +559,7 @@ TEST_CASE("simple xml tags")
     	auto apply = init_tag(xml);
     	REQUIRE(sv(apply.name()) == "math");
 
-    	run_test(apply, "V = if_((3.3 > 2), 3.3, 2);\n");
+    	run_test(apply, "V = if_(3.3 > 2, 3.3, 2);\n");
     }
 
 	SECTION("function definition")
@@ -487,7 +582,7 @@ TEST_CASE("simple xml tags")
     auto apply = init_tag(xml);
     REQUIRE(sv(apply.name()) == "ml:define");
 
-    run_test(apply, "HVdc = @(z) (3 * z)");
+    run_test(apply, "HVdc = @(z) 3 * z");
 	}
 	SECTION("boundVars")
 	{
@@ -0,0 +1,165 @@
+#include <catch2/catch_test_macros.hpp>
+#include "pugixml.hpp"
+#include "extract.hpp"
+#include "matlab.hpp"
+#include "snapshot.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+using sv = std::string_view;
+
+static std::string contents(const fs::path &path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), {});
+}
+static void overwrite(const fs::path &path, const std::string &bytes)
+{
+	std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size());
+}
+static std::string convert(const auto &node, std::size_t cse_threshold = 0)
+{
+	std::ostringstream os;
+	matlab::context ctx(matlab::options{cse_threshold});
+	ctx.convert(node, os);
+	for (auto &id : ctx.undefined_ids)
+		os << id << " = ?\n";
+	return os.str();
+}
+
+TEST_CASE("snapshots")
+{
+	const std::string xml = R"(<?xml version="1.0"?><worksheet xmlns:ml="http://schemas.mathsoft.com/math30">)"
+		R"(<settings><presentation><textStyle name="x"/></presentation></settings><regions>)"
+		R"(<region region-id="1"><math><ml:define><ml:id subscript="0">a</ml:id><ml:real>-3</ml:real></ml:define></math></region>)"
+		R"(<region region-id="2"><math><ml:define><ml:id>x</ml:id><ml:apply><ml:plus/>)"
+		R"(<ml:apply><ml:sqrt/><ml:apply><ml:pow/><ml:id subscript="0">a</ml:id><ml:id>b</ml:id></ml:apply></ml:apply>)"
+		R"(<ml:apply><ml:sqrt/><ml:apply><ml:pow/><ml:id subscript="0">a</ml:id><ml:id>b</ml:id></ml:apply></ml:apply>)"
+		R"(</ml:apply></ml:define></math><rendering item-idref="9"/></region>)"
+		R"(<region region-id="3"><text><p>a comment</p></text></region>)"
+		R"(<region region-id="4"><plot item-idref="9"/></region>)"
+		R"(</regions><binaryContent><item item-id="9" content-encoding="none">iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNk</item></binaryContent></worksheet>)";
+	pugi::xml_document doc;
+	REQUIRE(doc.load_string(xml.c_str()));
+
+	const auto dir = fs::temp_directory_path() / "mathcadconvert_snapshot_test";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	const auto path = (dir / "sheet.mcsnap").string();
+	REQUIRE(snapshot::write(doc, path, matlab::skipped));
+
+	SECTION("convert as the worksheet does")
+	{
+		snapshot::file file(path);
+		REQUIRE(file);
+		REQUIRE(file.verify());
+		CHECK(convert(file.document()) == convert(doc));
+		CHECK(convert(file.document(), 1) == convert(doc, 1));
+		CHECK(convert(file.document(), 1).starts_with("a_0 = -3;\ncse1 = sqrt(a_0^b);\n"));
+	}
+	SECTION("leave out what the converter skips")
+	{
+		snapshot::file file(path);
+		REQUIRE(file);
+		const auto worksheet = file.document().child("worksheet");
+		CHECK(worksheet.child("settings"));
+		CHECK_FALSE(worksheet.child("settings").child("presentation"));
+		CHECK_FALSE(worksheet.child("regions").child("region").next_sibling("region").child("rendering"));
+		CHECK(sv(worksheet.child("regions").child("region").child("math").first_child().first_child().attribute("subscript").value()) == "0");
+	}
+	SECTION("plots name items by the start of their payload")
+	{
+		snapshot::file file(path);
+		REQUIRE(file);
+		std::ostringstream os;
+		matlab::context ctx;
+		ctx.binary_dir = "sheet_files";
+		ctx.convert(file.document(), os);
+		CHECK(os.str().ends_with("figure; imshow(imread('sheet_files/9.png')); % a mathcad plot\n"));
+
+		// pugixml keeps the line breaks and indentation around a payload
+		pugi::xml_document indented;
+		REQUIRE(indented.load_string(R"(<worksheet><regions><region region-id="1"><plot item-idref="2"/></region></regions><binaryContent>)"
+			"<item item-id=\"2\" content-encoding=\"none\">\n                iVBORw0K\n GgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJ</item>"
+			"</binaryContent></worksheet>"));
+		const auto indented_path = (dir / "indented.mcsnap").string();
+		REQUIRE(snapshot::write(indented, indented_path, matlab::skipped));
+		snapshot::file mapped(indented_path);
+		REQUIRE(mapped);
+		const auto item = extract::find_item(mapped.document(), "2");
+		REQUIRE(item);
+		CHECK(extract::file_name(item) == "2.png");
+		CHECK(extract::file_name(item) == extract::file_name(extract::find_item(indented, "2")));
+	}
+	SECTION("refuse trees the format cannot hold")
+	{
+		std::string many = "<?xml?><worksheet><regions";
+		for (int i = 0; i < 70000; ++i)
+			many += " a" + std::to_string(i) + "=\"\"";
+		many += "/></worksheet>";
+		pugi::xml_document big;
+		REQUIRE(big.load_string(many.c_str()));
+		const auto rejected = (dir / "big.mcsnap").string();
+		CHECK_FALSE(snapshot::write(big, rejected, matlab::skipped));
+		CHECK_FALSE(fs::exists(rejected));
+	}
+	SECTION("reject other files")
+	{
+		auto bytes = contents(path);
+		const auto damage = [&](std::size_t at, char c)
+		{
+			auto damaged = bytes;
+			damaged[at] = c;
+			overwrite(path, damaged);
+		};
+		SECTION("magic")
+		{
+			damage(0, 'X');
+			CHECK_FALSE(snapshot::file(path));
+		}
+		SECTION("version")
+		{
+			damage(offsetof(snapshot::header, version), char(snapshot::version + 1));
+			snapshot::file file(path);
+			CHECK_FALSE(file);
+			CHECK(file.error().find("version") != std::string::npos);
+		}
+		SECTION("truncated")
+		{
+			overwrite(path, bytes.substr(0, bytes.size() - 8));
+			CHECK_FALSE(snapshot::file(path));
+			overwrite(path, bytes.substr(0, 10));
+			CHECK_FALSE(snapshot::file(path));
+		}
+		SECTION("missing")
+		{
+			CHECK_FALSE(snapshot::file((dir / "missing.mcsnap").string()));
+		}
+		SECTION("broken offsets")
+		{
+			snapshot::header h;
+			std::memcpy(&h, bytes.data(), sizeof(h));
+			// the document's first child pointing far outside the node table
+			damage(h.nodes + offsetof(snapshot::node_record, first_child) + 3, '\x40');
+			snapshot::file file(path);
+			REQUIRE(file);
+			CHECK_FALSE(file.verify());
+			CHECK(file.error().find("link") != std::string::npos);
+		}
+		SECTION("broken strings")
+		{
+			snapshot::header h;
+			std::memcpy(&h, bytes.data(), sizeof(h));
+			damage(h.nodes + sizeof(snapshot::node_record) + offsetof(snapshot::node_record, name) + 5, '\x01');
+			snapshot::file file(path);
+			REQUIRE(file);
+			CHECK_FALSE(file.verify());
+		}
+	}
+	fs::remove_all(dir);
+}